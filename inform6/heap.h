@@ -0,0 +1,318 @@
+!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!
+! heap.h
+! Binary heaps (priority queues) and HeapSort for Inform, using the same
+! array conventions as sorting.h. Freely usable by anyone for any purpose.
+!
+! Publically usable routines:
+!
+! heapify_words(arr, from, to [, comparison]);
+! heap_push(arr, from, to, value [, comparison]);
+! heap_pop(arr, from, to [, comparison]);
+! heap_replace(arr, from, to, value [, comparison]);
+! heapsort_words(arr, from, to [, comparison]);
+!
+! heapify_words_idx(arr, index, from, to [, comparison]);
+! heap_push_idx(arr, index, from, to, element [, comparison]);
+! heap_pop_idx(arr, index, from, to [, comparison]);
+! heap_replace_idx(arr, index, from, to, element [, comparison]);
+! heapsort_words_idx(arr, index, from, to [, comparison]);
+!
+! A heap is a word array, or part of one, kept in an order where the
+! element that would be sorted first is always at position 'from', and
+! where adding or removing an element takes O(log n) time. This makes a
+! heap the natural way to keep a queue of timed events, where the game only
+! ever needs to know which event is due next.
+!
+! The 'from', 'to' and comparison arguments work as in sorting.h: 'from' is
+! the index of the first element of the heap, 'to' the index of the last,
+! and a comparison function returns a non-zero value iff a should end up
+! after b. Without a comparison function, the smallest value is at the top.
+! In place of a comparison function, the heap routines also take a mode:
+! SORT_UNSIGNED, SORT_DESCENDING, or both added together. The heap is
+! then kept in that order without a routine call for each comparison, so
+! SORT_DESCENDING keeps the largest value at the top. Pass the same
+! comparison or mode to every call on the same heap.
+! The heap routines don't know how big the array is. Keep track of 'to'
+! yourself, and make sure there is room for one more element before pushing:
+!
+! heap_push returns the new value of 'to', which is one higher than before.
+! heap_pop returns the element at the top of the heap, and moves the last
+! element into its place, so that the heap now ends at to-1.
+! heap_replace returns the element at the top of the heap and puts the new
+! value in its place. This is the same as a pop followed by a push, but
+! takes half the time.
+! The top element can be looked at without removing it as arr-->from.
+!
+! Sample code for a queue of events ordered by the turn they are due:
+! Array event_turn --> 20;
+! Global last_event = -1;
+! ...
+! last_event = heap_push(event_turn, 0, last_event, turns + 5);
+! ...
+! while(last_event >= 0 && event_turn-->0 <= turns) {
+!   heap_pop(event_turn, 0, last_event--);
+!   ...
+! }
+!
+! The index-based heap routines leave the data array alone, and keep a heap
+! of element numbers in the index array instead, ordered by the values in
+! the data array. heapify_words_idx fills the index with the element numbers
+! from..to first, just like the index-based sort functions in sorting.h.
+! heap_push_idx adds an element number to the heap, and heap_pop_idx and
+! heap_replace_idx return element numbers. This is useful when each element
+! has more data on the side than the value it is ordered by: for example,
+! if event_turn holds the turn each event is due, the index heap can tell
+! which event is due next while event_routine-->e still belongs to event e.
+!
+! heapsort_words and heapsort_words_idx sort the range in ascending order
+! (or the order given by the comparison function or mode) in O(n log n)
+! time, with no scratch space at all. HeapSort is not stable.
+!
+!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!
+
+System_file;
+
+! These are the same as in sorting.h, which may be included before or after
+! this file.
+Default SORT_UNSIGNED 1;
+Default SORT_DESCENDING 2;
+
+! A comparison argument from 1 up to (but not including) _HP_MODES is a
+! mode. The mode-aware code adds u (the high bit, or 0) to each value, which
+! turns unsigned order into signed order, and takes ~ of it if d is set,
+! which turns the order around.
+Constant _HP_MODES 4;
+#Ifdef TARGET_GLULX;
+Constant _HP_HIGHBIT $80000000;
+#Ifnot;
+Constant _HP_HIGHBIT $8000;
+#Endif;
+
+!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!
+! Heap routines.
+!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!
+
+! The children of position i are at i+i-from+1 and i+i-from+2, and its
+! parent is at from+(i-from-1)/2. _hp_down and _hp_up move the hole at
+! position i down or up until v fits there.
+
+[ _hp_down arr from to i v comp   c u d k w x;
+  if(comp>0 && comp<_HP_MODES) {
+    u=(comp & SORT_UNSIGNED)*_HP_HIGHBIT;
+    d=comp & SORT_DESCENDING;
+    comp=0;
+  }
+  k=v+u;
+  if(d)
+    k=~k;
+  for(::) {
+    c=i+i-from+1;
+    if(c>to)
+      break;
+    if(comp) {
+      if(c<to && comp(arr-->c, arr-->(c+1)))
+        c++;
+      if(~~comp(v, arr-->c))
+        break;
+    } else {
+      w=arr-->c+u;
+      if(d)
+        w=~w;
+      if(c<to) {
+        x=arr-->(c+1)+u;
+        if(d)
+          x=~x;
+        if(w>x) {
+          c++;
+          w=x;
+        }
+      }
+      if(k<=w)
+        break;
+    }
+    arr-->i=arr-->c;
+    i=c;
+  }
+  arr-->i=v;
+];
+
+[ _hp_up arr from i v comp   c u d k w;
+  if(comp>0 && comp<_HP_MODES) {
+    u=(comp & SORT_UNSIGNED)*_HP_HIGHBIT;
+    d=comp & SORT_DESCENDING;
+    comp=0;
+  }
+  k=v+u;
+  if(d)
+    k=~k;
+  while(i>from) {
+    c=from+(i-from-1)/2;
+    if(comp) {
+      if(~~comp(arr-->c, v))
+        break;
+    } else {
+      w=arr-->c+u;
+      if(d)
+        w=~w;
+      if(w<=k)
+        break;
+    }
+    arr-->i=arr-->c;
+    i=c;
+  }
+  arr-->i=v;
+];
+
+[ heapify_words arr from to comp   i;
+  for(i=from+(to-from-1)/2: i>=from: i--)
+    _hp_down(arr, from, to, i, arr-->i, comp);
+];
+
+[ heap_push arr from to v comp;
+  to++;
+  _hp_up(arr, from, to, v, comp);
+  return to;
+];
+
+[ heap_pop arr from to comp   v;
+  v=arr-->from;
+  if(to>from)
+    _hp_down(arr, from, to-1, from, arr-->to, comp);
+  return v;
+];
+
+[ heap_replace arr from to v comp   t;
+  t=arr-->from;
+  _hp_down(arr, from, to, from, v, comp);
+  return t;
+];
+
+! The heap keeps the first element at the top, so HeapSort moves the top to
+! the end of the range each time, which sorts the range backwards, and then
+! turns it around.
+[ heapsort_words arr from to comp   i j v;
+  heapify_words(arr, from, to, comp);
+  for(i=to: i>from: i--) {
+    v=arr-->from;
+    _hp_down(arr, from, i-1, from, arr-->i, comp);
+    arr-->i=v;
+  }
+  for(i=from, j=to: i<j: i++, j--) {
+    v=arr-->i;
+    arr-->i=arr-->j;
+    arr-->j=v;
+  }
+];
+
+!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!
+! Index-based heap routines.
+!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!
+
+! In the index-based versions, v is the value of element e after u and d
+! have been applied, which for a comparison function is the value itself.
+[ _hpi_down arr index from to i e comp   c v u d w x;
+  if(comp>0 && comp<_HP_MODES) {
+    u=(comp & SORT_UNSIGNED)*_HP_HIGHBIT;
+    d=comp & SORT_DESCENDING;
+    comp=0;
+  }
+  v=arr-->e+u;
+  if(d)
+    v=~v;
+  for(::) {
+    c=i+i-from+1;
+    if(c>to)
+      break;
+    if(comp) {
+      if(c<to && comp(arr-->(index-->c), arr-->(index-->(c+1))))
+        c++;
+      if(~~comp(v, arr-->(index-->c)))
+        break;
+    } else {
+      w=arr-->(index-->c)+u;
+      if(d)
+        w=~w;
+      if(c<to) {
+        x=arr-->(index-->(c+1))+u;
+        if(d)
+          x=~x;
+        if(w>x) {
+          c++;
+          w=x;
+        }
+      }
+      if(v<=w)
+        break;
+    }
+    index-->i=index-->c;
+    i=c;
+  }
+  index-->i=e;
+];
+
+[ _hpi_up arr index from i e comp   c v u d w;
+  if(comp>0 && comp<_HP_MODES) {
+    u=(comp & SORT_UNSIGNED)*_HP_HIGHBIT;
+    d=comp & SORT_DESCENDING;
+    comp=0;
+  }
+  v=arr-->e+u;
+  if(d)
+    v=~v;
+  while(i>from) {
+    c=from+(i-from-1)/2;
+    if(comp) {
+      if(~~comp(arr-->(index-->c), v))
+        break;
+    } else {
+      w=arr-->(index-->c)+u;
+      if(d)
+        w=~w;
+      if(w<=v)
+        break;
+    }
+    index-->i=index-->c;
+    i=c;
+  }
+  index-->i=e;
+];
+
+[ heapify_words_idx arr index from to comp   i;
+  for(i=from:i<=to:i++)
+    index-->i=i;
+  for(i=from+(to-from-1)/2: i>=from: i--)
+    _hpi_down(arr, index, from, to, i, index-->i, comp);
+];
+
+[ heap_push_idx arr index from to e comp;
+  to++;
+  _hpi_up(arr, index, from, to, e, comp);
+  return to;
+];
+
+[ heap_pop_idx arr index from to comp   e;
+  e=index-->from;
+  if(to>from)
+    _hpi_down(arr, index, from, to-1, from, index-->to, comp);
+  return e;
+];
+
+[ heap_replace_idx arr index from to e comp   t;
+  t=index-->from;
+  _hpi_down(arr, index, from, to, from, e, comp);
+  return t;
+];
+
+[ heapsort_words_idx arr index from to comp   i j e;
+  heapify_words_idx(arr, index, from, to, comp);
+  for(i=to: i>from: i--) {
+    e=index-->from;
+    _hpi_down(arr, index, from, i-1, from, index-->i, comp);
+    index-->i=e;
+  }
+  for(i=from, j=to: i<j: i++, j--) {
+    e=index-->i;
+    index-->i=index-->j;
+    index-->j=e;
+  }
+];
@@ -12,25 +12,120 @@
 !
 ! QUICKSORT group
 ! ---------------
+! sort_bytes(arr, from, to);
+! sort_words(arr, from, to [, comparison]);
+! sort_words_idx(arr, index, from, to [, comparison]);
 ! inssort_bytes_idx(arr, index, from, to);
 ! inssort_words_idx(arr, index, from, to [, comparison]);
+! inssort_bytes_bidx(arr, index, from, to);
+! inssort_words_bidx(arr, index, from, to [, comparison]);
 ! qsort_bytes_idx(arr, index, from, to);
 ! qsort_words_idx(arr, index, from, to [, comparison]);
 ! inssort_bytes(arr, from, to);
 ! inssort_words(arr, from, to [, comparison]);
 ! qsort_bytes(arr, from, to);
 ! qsort_words(arr, from, to [, comparison]);
+! nth_bytes_idx(arr, index, from, to, k);
+! nth_words_idx(arr, index, from, to, k [, comparison]);
+! partial_sort_bytes_idx(arr, index, from, to, k);
+! partial_sort_words_idx(arr, index, from, to, k [, comparison]);
+! nth_bytes(arr, from, to, k);
+! nth_words(arr, from, to, k [, comparison]);
+! partial_sort_bytes(arr, from, to, k);
+! partial_sort_words(arr, from, to, k [, comparison]);
+! top_bytes(arr, from, to, n);
+! top_words(arr, from, to, n [, comparison]);
+! keysort_words_idx(arr, index, keys, from, to, keyfn);
+! keysort_words(arr, index, keys, from, to, keyfn);
+! sort_objects_by_prop(arr, from, to, property [, descending]);
+! sort_children(parent, property [, descending]);
+! sort_children_by(parent, comparison);
+! sort_records(arr, stride, key_offset, from, to [, comparison]);
+! sort_records_bytes(arr, stride, key_offset, from, to);
+! sort_words_with(keys, from, to, comparison, payload1 [, payload2, payload3]);
+! sort_bytes_with(keys, from, to, payload1 [, payload2, payload3]);
 !
 ! SHELLSORT group
 ! ---------------
 ! shsort_bytes_idx(arr, index, from, to);
 ! shsort_words_idx(arr, index, from, to [, comparison]);
+! shsort_bytes_bidx(arr, index, from, to);
+! shsort_words_bidx(arr, index, from, to [, comparison]);
+! stepsort_start(ctx, arr, from, to [, comparison]);
+! stepsort_step(ctx, n);
+! stepsort_done(ctx);
 ! shsort_bytes(arr, from, to);
 ! shsort_words(arr, from, to [, comparison]);
+! sort_calibrate();
 !
-! Which one of these three sort algorithms is the fastest, depends
+! COUNTINGSORT group
+! ------------------
+! countsort_bytes_idx(arr, index, from, to);
+! countsort_bytes(arr, from, to);
+!
+! RADIXSORT group
+! ---------------
+! radix_words_idx(arr, index, scratch, from, to [, mode]);
+! radix_words(arr, scratch, from, to [, mode]);
+!
+! STRINGSORT group
+! ----------------
+! strsort_idx(arr, index, from, to, mode);
+! strsort(arr, from, to, mode);
+!
+! MERGESORT group
+! ---------------
+! msort_bytes_idx(arr, index, scratch, from, to);
+! msort_words_idx(arr, index, scratch, from, to [, comparison]);
+! msort_bytes(arr, scratch, from, to);
+! msort_words(arr, scratch, from, to [, comparison]);
+! tsort_words_idx(arr, index, scratch, from, to [, comparison]);
+! tsort_words(arr, scratch, from, to [, comparison]);
+! ipsort_words_idx(arr, index, from, to [, comparison]);
+! ipsort_words(arr, from, to [, comparison]);
+!
+! SEARCH group
+! ------------
+! lower_bound_bytes_idx(arr, index, from, to, value);
+! upper_bound_bytes_idx(arr, index, from, to, value);
+! equal_range_bytes_idx(arr, index, from, to, value);
+! lower_bound_words_idx(arr, index, from, to, value [, comparison]);
+! upper_bound_words_idx(arr, index, from, to, value [, comparison]);
+! equal_range_words_idx(arr, index, from, to, value [, comparison]);
+! lower_bound_bytes(arr, from, to, value);
+! upper_bound_bytes(arr, from, to, value);
+! equal_range_bytes(arr, from, to, value);
+! lower_bound_words(arr, from, to, value [, comparison]);
+! upper_bound_words(arr, from, to, value [, comparison]);
+! equal_range_words(arr, from, to, value [, comparison]);
+! bsearch_words(arr, from, to, value);
+! bsearch_records(arr, stride, key_offset, from, to, value);
+! sorted_insert(table, max, value [, comparison]);
+! sorted_find(table, value [, comparison]);
+! sorted_remove(table, value [, comparison]);
+! sorted_remove_at(table, position);
+! sorted_range(table, low, high [, comparison]);
+! sorted_merge(table, max, arr, from, to [, comparison]);
+!
+! Which one of these sort algorithms is the fastest, depends
 ! on the data to be sorted. Here's a short guide:
 !
+! Use sort_bytes, sort_words and sort_words_idx when you don't know what
+! the data will look like, and let them choose. They compare each element
+! with the next to count the places where the order breaks, which also
+! settles data that is already sorted (left alone) or strictly reversed
+! (turned around). Then they look at a sample of pairs of elements far
+! apart, and at a sample of values. Ranges of up to SORTADAPTIVESMALL
+! (default 16) elements go to InsertionSort.
+! Byte arrays with many elements or few different values go to
+! CountingSort, and on Glulx, word arrays of SORTRADIXMIN (default 256)
+! elements or more go to RadixSort unless there is a comparison function.
+! Nearly sorted data, and data with few different values when QuickSort
+! isn't built to split three ways, goes to ShellSort, and the rest to
+! QuickSort. The first pass makes up to n comparisons, so when you do know
+! what the data looks like, calling the right routine yourself is faster.
+! The result is not always stable.
+!
 ! Use InsertionSort (inssort) when no value is expected to be far from 
 ! its correct position (up to roughly ten positions away is fine). Many 
 ! small disorders are quite ok. Also use InsertionSort when the sorting 
@@ -40,12 +135,243 @@
 ! This is not often a demand, but it happens.
 !
 ! Use QuickSort (qsort) when the data is expected to be entirely unsorted.
+! If the data holds many equal values, define QUICKSORT3WAY as 1 before
+! including this file. QuickSort will then split each partition three ways,
+! into values less than, equal to and greater than the pivot, so that a run
+! of equal values is done with after a single pass, instead of being split
+! up again and again.
+!
+! Use the selection functions (nth, partial_sort, top) when only some of
+! the data needs to end up sorted. They are part of the QuickSort group.
+! nth puts the element that belongs at position k in that position, with
+! no larger element before it and no smaller element after it. This takes
+! O(n) time on average, so nth(arr, from, to, from+(to-from)/2) finds the
+! median without sorting. partial_sort leaves the elements that belong at
+! positions from..k sorted in those positions, and the rest in no particular
+! order. top leaves the n largest elements sorted at the end of the range,
+! in positions to-n+1..to.
+!
+! Use the key-extraction functions (keysort) instead of a comparison
+! function that looks something up, like a property value, for each of the
+! elements it compares. keyfn is a function that takes an element and
+! returns its sort key, as a signed word. It is called exactly once per
+! element, the keys are stored in the keys array, and QuickSort then sorts
+! on the keys with the fast built-in comparison. keysort_words_idx builds an
+! index and leaves the data alone. keysort_words also needs an index array
+! to work in, and then moves the data (and the keys) into sorted order.
+! keys and index must have room for elements from..to, just like arr.
+! Sample key function and call to sort objects by weight:
+! [ weightkey o; return o.weight; ];
+! keysort_words(my_objects, my_index, my_keys, 1, my_objects-->0, weightkey);
+!
+! sort_objects_by_prop sorts an array of objects by the value of one of
+! their properties, in ascending order, or in descending order if the
+! descending argument is true. It works like keysort_words, but reads the
+! property itself, and uses arrays of its own for the keys and the index.
+! An object that doesn't provide the property is sorted as if the value was
+! 0, and a property holding a routine is sorted by the routine's address,
+! without running it. sort_children reorders the children of an object in
+! the object tree by a property (as sort_objects_by_prop), and
+! sort_children_by does the same with a comparison function (or mode).
+! They only ever move each child once.
+! They need room for the objects in arrays that hold SORTOBJECTSMAX
+! (default 64) objects. On Glulx, more space is taken from the heap when
+! needed. On the Z-machine, sort_objects_by_prop falls back to QuickSort
+! with a comparison function that looks the property up, and sort_children
+! and sort_children_by refuse to sort an object with more than
+! SORTOBJECTSMAX children.
+!
+! sort_records sorts an array of records, such as [object, score, turn]
+! triples, by one field, and moves the whole records. Each record is stride
+! bytes long, and has a word-sized key at byte key_offset within it, just
+! like the records that bsearch_records searches, and record number from
+! starts at arr+from*stride. sort_records_bytes does the same with a
+! byte-sized key. Like keysort_words, they copy the keys out, sort them with
+! QuickSort (so they are not stable), and then move each record into place
+! by following each cycle of the new order, so no record is moved more than
+! twice. sort_records takes a comparison function (or mode) for the keys.
+! They need room for the keys and the order of SORTRECORDSMAX (default 64)
+! records, and room to hold one record of up to SORTRECORDSIZE (default 16)
+! bytes. On Glulx, more space is taken from the heap when needed. On the
+! Z-machine, they refuse to sort more records, or longer ones, than that.
+! Sample call to sort a table of three-word records by score, highest
+! first:
+! Array scores --> obj1 10 25  obj2 30 12  obj3 20 40;
+! sort_records(scores, 3*WORDSIZE, WORDSIZE, 0, 2, SORT_DESCENDING);
+!
+! sort_words_with sorts the word array keys, and moves the elements of up
+! to three more arrays (the payloads) along with the keys, so that element
+! i of each payload still belongs with element i of keys afterwards. This
+! suits data kept as parallel arrays, one per field, which would otherwise
+! need an index and a double lookup for every access after sorting.
+! sort_bytes_with does the same for a byte array of keys. The payloads are
+! word arrays, unless bit 1, 2 or 4 of the global sort_with_bytes is set
+! to mark payload 1, 2 or 3 as a byte array. Each call sets sort_with_bytes
+! back to 0, so set it just before every call that needs it. Unused
+! payloads are 0.
+! Pass 0 as the comparison to sort_words_with for the usual order. They
+! work like sort_records, sorting an index with QuickSort (so they are not
+! stable) and then following the cycles of the new order, and need room
+! for the order of SORTWITHMAX (default 64) elements. On Glulx, more space
+! is taken from the heap when needed. On the Z-machine, they refuse to sort
+! more elements than that.
+! Sample call to sort monsters by level, moving their names and hit points
+! (a byte array) along:
+! sort_with_bytes = 2;
+! sort_words_with(mon_level, 0, 9, 0, mon_name, mon_hp);
 !
 ! Use ShellSort (shsort) when the data may or may not be nearly in order,
 ! when there may or may not be elements that are far from their correct
 ! position, and when you can't decide which algorithm is the best. It's
 ! a very good allround algorithm.
 !
+! Use the step-by-step ShellSort (stepsort) to sort a large array a little
+! at a time, for example from a daemon, so that the game never stops for
+! long. ctx is a word array with room for STEPSORT_SIZE words, which holds
+! everything about one sort, so that several sorts can be under way at the
+! same time. stepsort_start sets up a sort of arr, without comparing
+! anything. Each call to stepsort_step then makes at most n comparisons,
+! and returns true once the array is sorted, as does stepsort_done. The
+! array always holds all of its elements, in a more and more sorted order,
+! so it can be read between steps, but it must not be changed until the
+! sort is done (or started over). stepsort swaps elements instead of
+! shifting them, which makes it somewhat slower than shsort_words in all.
+! Sample code:
+! Array score_sort --> STEPSORT_SIZE;
+! ...
+! stepsort_start(score_sort, score_table, 1, score_table-->0, SORT_DESCENDING);
+! ...
+! Object score_sorter
+!   with daemon [; if(stepsort_step(score_sort, 100)) StopDaemon(self); ];
+! ...
+! StartDaemon(score_sorter);
+!
+! Use MergeSort (msort) when the sorting has to be stable and there is too
+! much data for InsertionSort. MergeSort needs a scratch array to work in.
+! For the direct sort functions it must have room for to-from+1 elements
+! of the same size as the data (bytes for msort_bytes, words for
+! msort_words), for the index-based sort functions it must have room for
+! to-from+1 words. On Glulx, scratch may be given as 0, and the scratch
+! space is then taken from the heap with @malloc and freed afterwards. If
+! no scratch space can be had, the word MergeSort functions fall back to
+! the in-place MergeSort (ipsort, below), which is just as stable. The byte
+! MergeSort functions fall back to CountingSort, which is stable as well,
+! or to a plain (stable, but slow) InsertionSort if the CountingSort group
+! has been left out.
+!
+! Use TimSort (tsort) for word data that is mostly in order already, for
+! example an array that was sorted, and then had a few elements added at
+! the end or changed. TimSort is a stable MergeSort that looks for runs of
+! elements that are already in order (or in strictly reverse order, which
+! it turns around), and only merges those runs. Sorted data is done with
+! in a single pass, and a sorted array with a short unsorted tail costs
+! little more than sorting the tail. When a merge keeps taking elements
+! from the same run, it starts skipping ahead in larger and larger steps,
+! and moves whole blocks at a time. On random data, TimSort is about as
+! fast as MergeSort. The scratch array needs room for (to-from)/2+1 words,
+! and works like it does for MergeSort otherwise.
+!
+! Use the in-place MergeSort (ipsort) for word data when the sorting has to
+! be stable, but there is no room for a scratch array, as is often the case
+! on the Z-machine. It sorts runs of MERGESORTRUN elements with
+! InsertionSort, and then merges them by rotating blocks of elements, which
+! needs no scratch space at all. This takes O(n log^2 n) time, so it is
+! slower than MergeSort with a scratch array, but unlike InsertionSort it
+! stays usable for hundreds or thousands of elements. Runs that are already
+! in order aren't merged, so sorted data is done with in a single pass.
+!
+! CountingSort (countsort) only sorts bytes. It never compares two elements,
+! but counts how many there are of each of the 256 possible values, which
+! makes it the fastest choice for all but the smallest byte arrays. It uses
+! a 256-word table of its own, and the index-based version is stable.
+! qsort_bytes, qsort_bytes_idx, shsort_bytes and shsort_bytes_idx hand
+! arrays of more than COUNTSORTLIMIT elements over to CountingSort, unless
+! the CountingSort group has been left out.
+!
+! RadixSort (radix) only sorts words. Like CountingSort it never compares two
+! elements, but sorts the words one byte at a time, starting with the least
+! significant byte, which takes WORDSIZE passes over the data. RadixSort is
+! stable, it takes the same time regardless of how the data is ordered, and
+! it is the fastest choice for large word arrays. The mode argument is 0 for
+! the ordinary signed order, SORT_UNSIGNED for unsigned order, and either of
+! these plus SORT_DESCENDING to sort in descending order. Like MergeSort,
+! RadixSort needs a scratch array with room for to-from+1 words, which may
+! be given as 0 on Glulx to take the space from the heap.
+!
+! On Glulx, InsertionSort finds where each element goes with a binary
+! search, and moves the elements in its way with a single @mcopy, which is
+! much faster than moving them one at a time. Elements that are already in
+! place cost a single comparison, so this is still the best way to sort
+! data that is nearly in order. MergeSort and RadixSort also use @mcopy to
+! move blocks of data, and CountingSort and RadixSort use @mzero to clear
+! their tables. This needs a Glulx 3.1 interpreter, which all current ones
+! are.
+!
+! StringSort (strsort) sorts an array of strings into alphabetical order.
+! arr holds the addresses of the strings, and mode says what kind of
+! strings they are: STRSORT_STRING for arrays declared with 'string' (a
+! length byte and then the characters), STRSORT_BUFFER for arrays declared
+! with 'buffer' (a length word and then the characters, as written by
+! print_to_array or @output_stream), or STRSORT_DICT for dictionary words.
+! Add STRSORT_FOLD to the mode to make the sort ignore case. StringSort is
+! a multikey QuickSort, which looks at each character of each string about
+! once, instead of comparing whole strings again and again, and groups of
+! at most STRSORTLIMIT (default 8) strings are finished with InsertionSort.
+!
+! The search functions find things in data that has already been sorted,
+! in O(log n) time instead of looking at every element. The data must be
+! sorted in the same order the search uses: with the same comparison
+! function, or in ascending order if there is none. For the index-based
+! search functions, the index must come from the matching index-based sort
+! function, and the position returned is a position in the index.
+! lower_bound returns the position of the first element that is not less
+! than the value, and upper_bound the position of the first element that is
+! greater than it. Both return to+1 if there is no such element. The value
+! could be inserted at either position without breaking the order.
+! equal_range returns the lower bound and stores the upper bound in the
+! global sort_range_end, so that the elements equal to the value are the
+! ones from the return value up to sort_range_end-1. If there are none,
+! the two are the same.
+! Sample code to count how many elements are equal to 10:
+! i = equal_range_words(my_word_table, 1, my_word_table-->0, 10);
+! count = sort_range_end - i;
+! bsearch_words looks for an element that is exactly equal to the value, and
+! returns its position, or -1 if it isn't there. bsearch_records does the
+! same for an array of records that are stride bytes long each, and have a
+! word-sized key at byte key_offset within the record. Record number from
+! starts at arr+from*stride. Both of these compare the keys as unsigned
+! values, so the data must be sorted in unsigned order (which is the same
+! as the ordinary order if there are no negative keys). On Glulx they use
+! the @binarysearch opcode, which is very fast.
+!
+! The sorted table functions keep a word table (an array declared with
+! 'table', with the number of elements in table-->0) sorted as elements are
+! added and removed, so it never has to be sorted again. Each of them finds
+! its place with a binary search, and then moves the elements after it up or
+! down one step in a single block, with @mcopy on Glulx. max is the number
+! of elements the table has room for. sorted_insert puts the value after any
+! equal elements already there, and returns its position, or 0 if the table
+! is full. sorted_find returns the position of the first element equal to
+! the value, or 0 if there is none, and sorted_remove removes that element
+! and returns where it was, or 0. sorted_remove_at removes the element at a
+! given position and returns true, or returns false and does nothing if
+! there is no element there. sorted_range returns the position of the
+! first element that is not less than low, and stores the position after
+! the last one that is not greater than high in sort_range_end, so the
+! elements from low to high are the ones from the return value up to
+! sort_range_end-1.
+! sorted_merge adds the elements arr-->from..arr-->to to the table in one
+! pass, which is much faster than adding them one at a time. They must
+! already be sorted in the same order. If there isn't room for all of them,
+! it adds none and returns false.
+! Sample code for a queue of timers, ordered by the turn they are due:
+! Array timers table 20;
+! ...
+! sorted_insert(timers, 20, turns + 5);
+! ...
+! i = sorted_range(timers, 0, turns);
+! (Timers i to sort_range_end-1 are due now.)
+!
 ! The InsertionSort algorithm is very closely related to ShellSort.
 ! However, the InsertionSort functions are in the QuickSort group in this
 ! library. This is only because this particular QuickSort implementation 
@@ -56,11 +382,19 @@
 ! All functions that take an index argument are called index-based sort
 ! functions. These will not alter the order of the original array, but
 ! will instead build an index on the side that says in which order the
-! array elements should be. The index entries are always word-sized,
-! regardless of the size of the data elements. This is quite powerful
-! because it means you can keep track of related data on the side, i.e.
-! if you sort an array containing people's salaries, you will still know
-! what person had what salary even after sorting.
+! array elements should be. The index entries are word-sized, except for
+! the _bidx functions below, regardless of the size of the data elements.
+! This is quite powerful because it means you can keep track of related
+! data on the side, i.e. if you sort an array containing people's
+! salaries, you will still know what person had what salary even after
+! sorting.
+!
+! The InsertionSort and ShellSort functions ending in _bidx are index-based
+! sort functions that build a byte array index instead, which takes half the
+! space. This is worth having on the Z-machine, where dynamic memory is
+! scarce. The element numbers have to fit in a byte, so 'to' can be at most
+! 255. Unlike shsort_bytes_idx, shsort_bytes_bidx never hands the data over
+! to CountingSort, which builds a word index.
 !
 ! All sort-functions that are not index-based are referred to as direct sort
 ! functions.
@@ -81,41 +415,504 @@
 ! qsort_words(my_word_table, 1, my_word_table-->0, lessthan);
 !
 ! All functions that sort word-data use the standard Inform signed comparison
-! by default. If unsigned comparison is required, supply your own comparison
-! function instead.
+! by default. In place of a comparison function, the word sort and search
+! functions also take a mode, as RadixSort does: SORT_UNSIGNED for unsigned
+! order, SORT_DESCENDING for descending order, or SORT_UNSIGNED +
+! SORT_DESCENDING for both. This is much faster than a comparison function
+! of your own. The elements are changed into values that are in the
+! ordinary signed order when the originals are in the order asked for,
+! sorted with the built-in comparison, and changed back. The index-based
+! functions leave the data alone, and compare the elements as if they had
+! been changed. For example, to sort a table of addresses:
+! qsort_words(my_word_table, 1, my_word_table-->0, SORT_UNSIGNED);
 !
 ! To stop some of the routines from compiling (in order to save space), one 
 ! can set one or more of the following constants, before including this file:
-! NOQUICKSORT, NOSHELLSORT,
+! NOQUICKSORT, NOSHELLSORT, NOMERGESORT, NOCOUNTSORT, NORADIXSORT,
+! NOADAPTIVESORT, NOSELECTION, NOKEYSORT, NOOBJECTSORT, NORECORDSORT,
+! NOPARALLELSORT, NOSTRINGSORT, NOSEARCH,
 ! NOINDEXSORT, NODIRECTSORT,
 ! NOBYTESORT, NOWORDSORT
-! If no routines are removed in this manner, this package will take up roughly
-! 3.5 KB in the story file, with debugging information turned off.
+! NOOBJECTSORT leaves out sort_objects_by_prop, sort_children and
+! sort_children_by, which are also left out by NOKEYSORT, since they use
+! its routines. sort_records* (NORECORDSORT) and sort_*_with
+! (NOPARALLELSORT) only need the QuickSort group.
+! The package has grown a lot since it took up about 3.5 KB, and with every
+! group compiled in it is many times that size, so it is worth leaving out
+! the groups a game doesn't use, especially on the Z-machine. To see what a
+! group costs, compile the game with the -s switch (statistics) with and
+! without it, and compare the sizes of the code areas.
 !
-! There are two more constants which may be defined before including this file:
+! There are four more constants which may be defined before including this
+! file:
 ! QUICKSORTLIMIT
 ! SHELLSORTCONST
+! MERGESORTRUN
+! COUNTSORTLIMIT
 ! If you're _really_ interested in fine-tuning your sorting, these constants
 ! may be of interest to you. Otherwise, feel free to forget about them right
 ! away. If any of them are defined, it must be set to a value greater than
-! zero, or the sorting routines will crash. Any value higher than 20 is
-! highly unlikely to be useful. Which values are the best (i.e. giving the
+! zero, or the sorting routines will crash. For QUICKSORTLIMIT,
+! SHELLSORTCONST and MERGESORTRUN, any value higher than 20 is highly
+! unlikely to be useful. Which values are the best (i.e. giving the
 ! fastest sorting) depends on which interpreter will be used to run the
 ! program, as well as the  nature of the data to be sorted.
-! The programmer is free to define both constants, define one of them, or
-! leave both undefined. Leaving them undefined will set them to values
+! The programmer is free to define all of the constants, some of them, or
+! leave them all undefined. Leaving them undefined will set them to values
 ! optimised for sorting random data under WinFrotz (QUICKSORTLIMIT=10,
-! SHELLSORTCONST=3), and this is generally good enough for any data under any
-! interpreter. Of course, QUICKSORTLIMIT only affects QuickSort, and
-! SHELLSORTCONST only affects ShellSort.
+! SHELLSORTCONST=3) and a MERGESORTRUN of 8, and this is generally good
+! enough for any data under any interpreter. Of course, QUICKSORTLIMIT only
+! affects QuickSort, SHELLSORTCONST only affects ShellSort and MERGESORTRUN
+! (the length of the runs that MergeSort builds with InsertionSort before it
+! starts merging) only affects MergeSort. COUNTSORTLIMIT (default 64) is
+! the size above which QuickSort and ShellSort leave byte arrays to
+! CountingSort.
+!
+! QUICKSORTLIMIT and SHELLSORTCONST only set the starting values of two
+! globals, sort_qs_limit and sort_shell_const, which the sort routines read
+! each time they are called, so they can also be changed while the game is
+! running. ShellSort can use a table of gaps instead of the sequence given
+! by sort_shell_const: set sort_shell_gaps to sort_gaps_ciura (Ciura's
+! gaps) or sort_gaps_tokuda (Tokuda's gaps), both of which usually beat the
+! default sequence, or to a table of your own, in ascending order and
+! starting with 1. Set it to 0 to go back to sort_shell_const.
+! The best values depend on the interpreter, so a game that is played on
+! many of them can call sort_calibrate() once, for example in Initialise.
+! On Glulx, it times QuickSort with sort_qs_limit from 4 to 20, and
+! ShellSort with sort_shell_const from 2 to 4 and with both gap tables, on
+! SORTCALIBRATESIZE (default 1000) words taken from the heap. It keeps the
+! fastest settings, and returns true. Each candidate sorts the data three
+! times, so this is worth doing once, not before every sort. On the
+! Z-machine, which has no clock, and on interpreters without a clock or a
+! heap, it changes nothing and returns false.
+!
+! To find out why a sort is slow, define SORTING_STATS before including
+! this file. The sort and search routines then count their work in five
+! globals, which sort_stats_reset() sets to zero:
+! sort_stat_compares - comparisons between two elements (or two strings)
+! sort_stat_calls    - calls to a comparison function of your own (a mode
+!                      makes no calls)
+! sort_stat_moves    - elements shifted, swapped, merged or placed
+! sort_stat_depth    - the most partitioning rounds QuickSort or a selection
+!                      function has used on one part of the data, out of
+!                      a budget of about 2*log2(n). If it reaches the budget,
+!                      HeapSort has taken over.
+! sort_stat_path     - the way the last call to sort_bytes, sort_words or
+!                      sort_words_idx sorted its data, as one of the
+!                      SORT_PATH_ constants
+! Many comparisons and calls for the size of the data mean an expensive
+! comparison function, and a depth close to the budget means bad pivots.
+! With SORTING_STATS defined, the word sort functions always go through a
+! comparison function, which makes them slower. Without it, none of this
+! code is compiled at all. @binarysearch on Glulx (bsearch_words and
+! bsearch_records) doesn't show its comparisons, and the routines in heap.h
+! aren't counted.
 !
 !!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!
 
 System_file;
 
+! heap.h has the same two, and may be included before or after this file.
+Default SORT_UNSIGNED 1;
+Default SORT_DESCENDING 2;
+
+#Ifndef NOWORDSORT;
+
+! A comparison argument from 1 up to (but not including) _SORT_MODES is a
+! mode. _sort_flip changes the words from..to so that the plain signed order
+! of the new values is the order asked for by mode: adding the high bit
+! turns unsigned order into signed order, and ~ turns the order around.
+! Both changes undo themselves, so calling _sort_flip a second time puts the
+! original values back.
+
+Constant _SORT_MODES 4;
+#Ifdef TARGET_GLULX;
+Constant _SORT_HIGHBIT $80000000;
+#Ifnot;
+Constant _SORT_HIGHBIT $8000;
+#Endif;
+
+[ _sort_flip arr from to mode   i;
+  if(mode==SORT_UNSIGNED)
+    for(i=from: i<=to: i++)
+      arr-->i=arr-->i+_SORT_HIGHBIT;
+  else if(mode==SORT_DESCENDING)
+    for(i=from: i<=to: i++)
+      arr-->i=~(arr-->i);
+  else
+    for(i=from: i<=to: i++)
+      arr-->i=~(arr-->i)+_SORT_HIGHBIT;
+];
+
+! The index-based sort functions and the search functions must not change
+! the data, so they compare with mode-aware code of their own instead,
+! which adds u (the high bit, or 0) to each element and takes ~ of it if d
+! (descending) is set, without calling a routine for each comparison.
+
+! Copies n words from src to dst. The two may overlap.
+
+#Ifdef TARGET_GLULX;
+
+[ _sort_copy src dst n;
+  n=n*WORDSIZE;
+  @mcopy n src dst;
+];
+
+#Ifnot; ! TARGET_GLULX
+
+[ _sort_copy src dst n   i;
+  if(dst+_SORT_HIGHBIT > src+_SORT_HIGHBIT)
+    for(i=n-1: i>=0: i--)
+      dst-->i=src-->i;
+  else
+    for(i=0: i<n: i++)
+      dst-->i=src-->i;
+];
+
+#Endif; ! TARGET_GLULX
+
+#Endif; ! Not NOWORDSORT
+
+#Ifdef SORTING_STATS;
+
+Global sort_stat_compares;
+Global sort_stat_calls;
+Global sort_stat_moves;
+Global sort_stat_depth;
+Global sort_stat_path;
+Global _sort_stat_comp;
+Global _sort_stat_top;
+
+[ sort_stats_reset;
+  sort_stat_compares=0;
+  sort_stat_calls=0;
+  sort_stat_moves=0;
+  sort_stat_depth=0;
+  sort_stat_path=0;
+];
+
+! The word sort routines replace their comparison function with this one,
+! so that every comparison they make is counted, including the built-in
+! ones. The real comparison function or mode, if any, is kept in
+! _sort_stat_comp. Only calls to a real function count in sort_stat_calls.
+[ _sort_stat_cmp a b;
+  sort_stat_compares++;
+  #Ifndef NOWORDSORT;
+  if(_sort_stat_comp>0 && _sort_stat_comp<_SORT_MODES) {
+    if(_sort_stat_comp & SORT_UNSIGNED) {
+      a=a+_SORT_HIGHBIT;
+      b=b+_SORT_HIGHBIT;
+    }
+    if(_sort_stat_comp & SORT_DESCENDING)
+      return a<b;
+    return a>b;
+  }
+  #Endif;
+  if(_sort_stat_comp) {
+    sort_stat_calls++;
+    return _sort_stat_comp(a, b);
+  }
+  return a>b;
+];
+
+[ _sort_stat_wrap comp;
+  if(comp~=_sort_stat_cmp)
+    _sort_stat_comp=comp;
+  return _sort_stat_cmp;
+];
+
+#Endif; ! SORTING_STATS
+
+#Ifdef TARGET_GLULX;
+
+! Takes size bytes from the Glulx heap, for use as scratch space. Returns 0 if
+! the interpreter can't do @malloc, or if the heap is exhausted.
+[ _sort_malloc size   addr;
+  @gestalt 7 0 addr;
+  if(addr==0)
+    return 0;
+  @malloc size addr;
+  return addr;
+];
+
+#Endif; ! TARGET_GLULX
+
+#Ifndef NOCOUNTSORT;
+#Ifndef NOBYTESORT;
+
+Default COUNTSORTLIMIT 64;
+
+!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!
+! CountingSort routines.
+!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!
+
+Array _sort_hist --> 256;
+
+#Ifndef NOINDEXSORT;
+
+[ countsort_bytes_idx arr index from to   i v n lo hi c;
+  for(i=from:i<=to:i++)
+    index-->i=i;
+  if(to<=from)
+    return;
+  lo=255;
+  #Ifdef TARGET_GLULX;
+  @mzero 1024 _sort_hist;
+  #Ifnot;
+  for(i=0: i<256: i++)
+    _sort_hist-->i=0;
+  #Endif;
+  for(i=from: i<=to: i++) {
+    v=arr->i;
+    _sort_hist-->v=_sort_hist-->v+1;
+    if(v<lo)
+      lo=v;
+    if(v>hi)
+      hi=v;
+  }
+  for(v=lo, n=from: v<=hi: v++) {
+    c=_sort_hist-->v;
+    _sort_hist-->v=n;
+    n=n+c;
+  }
+  for(i=from: i<=to: i++) {
+    v=arr->i;
+    index-->(_sort_hist-->v)=i;
+    _sort_hist-->v=_sort_hist-->v+1;
+  }
+  #Ifdef SORTING_STATS;
+  sort_stat_moves=sort_stat_moves+to-from+1;
+  #Endif;
+];
+
+#Endif; ! Not NOINDEXSORT;
+
+#Ifndef NODIRECTSORT;
+
+[ countsort_bytes arr from to   i v n lo hi;
+  if(to<=from)
+    return;
+  lo=255;
+  #Ifdef TARGET_GLULX;
+  @mzero 1024 _sort_hist;
+  #Ifnot;
+  for(i=0: i<256: i++)
+    _sort_hist-->i=0;
+  #Endif;
+  for(i=from: i<=to: i++) {
+    v=arr->i;
+    _sort_hist-->v=_sort_hist-->v+1;
+    if(v<lo)
+      lo=v;
+    if(v>hi)
+      hi=v;
+  }
+  for(v=lo, i=from: v<=hi: v++)
+    for(n=_sort_hist-->v: n>0: n--)
+      arr->(i++)=v;
+  #Ifdef SORTING_STATS;
+  sort_stat_moves=sort_stat_moves+to-from+1;
+  #Endif;
+];
+
+#Endif; ! Not NODIRECTSORT;
+
+#Endif; ! Not NOBYTESORT;
+#Endif; ! Not NOCOUNTSORT
+
+#Ifndef NORADIXSORT;
+#Ifndef NOWORDSORT;
+
+!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!
+! RadixSort routines.
+!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!
+
+#Ifndef _sort_hist;
+Array _sort_hist --> 256;
+#Endif;
+
+! Turns the byte counts in _sort_hist into start positions. The buckets are
+! laid out in reverse for a descending sort, and with the top bit of the
+! byte flipped for the most significant byte of a signed sort.
+[ _rs_offsets flip desc   i v c n;
+  for(i=0: i<256: i++) {
+    v=i;
+    if(flip)
+      v=(v+128)&255;
+    if(desc)
+      v=255-v;
+    c=_sort_hist-->v;
+    _sort_hist-->v=n;
+    n=n+c;
+  }
+];
+
+! One pass over byte b of each word (0 is the most significant byte), moving
+! the n words at src to dst. Returns false, without moving anything, if all
+! the words have the same value in byte b.
+
+#Ifndef NOINDEXSORT;
+
+[ _rswi_pass arr src dst n b flip desc   i v c;
+  #Ifdef TARGET_GLULX;
+  @mzero 1024 _sort_hist;
+  #Ifnot;
+  for(i=0: i<256: i++)
+    _sort_hist-->i=0;
+  #Endif;
+  for(i=0: i<n: i++) {
+    v=arr->((src-->i)*WORDSIZE+b);
+    _sort_hist-->v=_sort_hist-->v+1;
+  }
+  if(_sort_hist-->(arr->((src-->0)*WORDSIZE+b))==n)
+    rfalse;
+  _rs_offsets(flip, desc);
+  for(i=0: i<n: i++) {
+    v=arr->((src-->i)*WORDSIZE+b);
+    c=_sort_hist-->v;
+    dst-->c=src-->i;
+    _sort_hist-->v=c+1;
+  }
+  #Ifdef SORTING_STATS;
+  sort_stat_moves=sort_stat_moves+n;
+  #Endif;
+  rtrue;
+];
+
+[ radix_words_idx arr index scratch from to mode   i n b src dst flip;
+  for(i=from:i<=to:i++)
+    index-->i=i;
+  if(to<=from)
+    return;
+  #Ifdef TARGET_GLULX;
+  if(scratch==0) {
+    scratch=_sort_malloc((to-from+1)*WORDSIZE);
+    if(scratch) {
+      radix_words_idx(arr, index, scratch, from, to, mode);
+      @mfree scratch;
+      return;
+    }
+  }
+  #Endif;
+  if(scratch==0) {
+    print "[** Programming error: radix_words_idx needs a scratch array **]^";
+    return;
+  }
+  n=to-from+1;
+  src=index+from*WORDSIZE;
+  dst=scratch;
+  for(b=WORDSIZE-1: b>=0: b--) {
+    flip=(b==0 && (mode & SORT_UNSIGNED)==0);
+    if(_rswi_pass(arr, src, dst, n, b, flip, mode & SORT_DESCENDING)) {
+      i=src;
+      src=dst;
+      dst=i;
+    }
+  }
+  if(src==scratch) {
+    #Ifdef TARGET_GLULX;
+    n=n*WORDSIZE;
+    @mcopy n src dst;
+    #Ifnot;
+    for(i=0: i<n: i++)
+      dst-->i=src-->i;
+    #Endif;
+  }
+];
+
+#Endif; ! Not NOINDEXSORT;
+
+#Ifndef NODIRECTSORT;
+
+[ _rsw_pass src dst n b flip desc   i v c p;
+  #Ifdef TARGET_GLULX;
+  @mzero 1024 _sort_hist;
+  #Ifnot;
+  for(i=0: i<256: i++)
+    _sort_hist-->i=0;
+  #Endif;
+  for(i=0, p=src+b: i<n: i++, p=p+WORDSIZE) {
+    v=p->0;
+    _sort_hist-->v=_sort_hist-->v+1;
+  }
+  if(_sort_hist-->(src->b)==n)
+    rfalse;
+  _rs_offsets(flip, desc);
+  for(i=0, p=src+b: i<n: i++, p=p+WORDSIZE) {
+    v=p->0;
+    c=_sort_hist-->v;
+    dst-->c=src-->i;
+    _sort_hist-->v=c+1;
+  }
+  #Ifdef SORTING_STATS;
+  sort_stat_moves=sort_stat_moves+n;
+  #Endif;
+  rtrue;
+];
+
+[ radix_words arr scratch from to mode   i n b src dst flip;
+  if(to<=from)
+    return;
+  #Ifdef TARGET_GLULX;
+  if(scratch==0) {
+    scratch=_sort_malloc((to-from+1)*WORDSIZE);
+    if(scratch) {
+      radix_words(arr, scratch, from, to, mode);
+      @mfree scratch;
+      return;
+    }
+  }
+  #Endif;
+  if(scratch==0) {
+    print "[** Programming error: radix_words needs a scratch array **]^";
+    return;
+  }
+  n=to-from+1;
+  src=arr+from*WORDSIZE;
+  dst=scratch;
+  for(b=WORDSIZE-1: b>=0: b--) {
+    flip=(b==0 && (mode & SORT_UNSIGNED)==0);
+    if(_rsw_pass(src, dst, n, b, flip, mode & SORT_DESCENDING)) {
+      i=src;
+      src=dst;
+      dst=i;
+    }
+  }
+  if(src==scratch) {
+    #Ifdef TARGET_GLULX;
+    n=n*WORDSIZE;
+    @mcopy n src dst;
+    #Ifnot;
+    for(i=0: i<n: i++)
+      dst-->i=src-->i;
+    #Endif;
+  }
+];
+
+#Endif; ! Not NODIRECTSORT;
+
+#Endif; ! Not NOWORDSORT;
+#Endif; ! Not NORADIXSORT
+
 #Ifndef NOQUICKSORT;
 
 Default QUICKSORTLIMIT 10;
+Default QUICKSORT3WAY 0;
+
+Global sort_qs_limit = QUICKSORTLIMIT;
+
+! The QuickSort routines are introsorts: each call gets a budget of roughly
+! 2*log2(n) partitioning rounds, and a partition that is still unsorted when
+! the budget runs out is handed to HeapSort instead. This puts an O(n log n)
+! bound on inputs that would otherwise drive QuickSort quadratic.
+[ _qs_depth n   d;
+  for(d=0: n>1: n=n/2)
+    d=d+2;
+  #Ifdef SORTING_STATS;
+  _sort_stat_top=d;
+  #Endif;
+  return d;
+];
 
 !!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!
 ! Index-based InsertionSort and QuickSort routines.
@@ -125,21 +922,129 @@ Default QUICKSORTLIMIT 10;
 
 #Ifndef NOBYTESORT;
 
+#Ifdef TARGET_GLULX;
+
+[ _isbi_sub arr index from to   i v vi lo hi m len src;
+  for(i=from+1: i<=to: i++) {
+    vi=index-->i;
+    v=arr->vi;
+    #Ifdef SORTING_STATS;
+    sort_stat_compares++;
+    #Endif;
+    if(arr->(index-->(i-1)) <= v)
+      continue;
+    lo=from;
+    hi=i-1;
+    while(lo<hi) {
+      m=lo+(hi-lo)/2;
+      #Ifdef SORTING_STATS;
+      sort_stat_compares++;
+      #Endif;
+      if(arr->(index-->m) > v)
+        hi=m;
+      else
+        lo=m+1;
+    }
+    #Ifdef SORTING_STATS;
+    sort_stat_moves=sort_stat_moves+i-lo;
+    #Endif;
+    len=(i-lo)*WORDSIZE;
+    src=index+lo*WORDSIZE;
+    m=src+WORDSIZE;
+    @mcopy len src m;
+    index-->lo=vi;
+  }
+];
+
+#Ifnot;
+
 [ _isbi_sub arr index from to   i j v vi f1;
   f1=from + 1;
-  for(i=f1, j=i, vi=index-->i, v=arr->vi : i<=to : index-->(j+1)=vi, i++, j=i, vi=index-->i, v=arr->vi )
+  for(i=f1, j=i, vi=index-->i, v=arr->vi : i<=to : index-->(j+1)=vi, i++, j=i, vi=index-->i, v=arr->vi ) {
     while(j-- >= f1  && arr->(index-->j) > v)
       index-->(j+1)=index-->j;
+    #Ifdef SORTING_STATS;
+    sort_stat_moves=sort_stat_moves+i-j-1;
+    sort_stat_compares=sort_stat_compares+i-j-1+(j>=from);
+    #Endif;
+  }
 ];
 
+#Endif; ! TARGET_GLULX
+
 [ inssort_bytes_idx arr index from to   i;
   for(i=from:i<=to:i++)
     index-->i=i;
   _isbi_sub(arr, index, from, to);
 ];
 
-[ _qsbi_sub arr index from to   i j m temp vm vt p;
+! Element i is still at position i of the index when its turn comes, so
+! the _bidx InsertionSort functions don't fill in the index first.
+[ inssort_bytes_bidx arr index from to   i j v;
+  if(to>255) {
+    print "[** Programming error: inssort_bytes_bidx: to is more than 255 **]^";
+    return;
+  }
+  for(i=from: i<=to: i++) {
+    v=arr->i;
+    for(j=i-1: j>=from && arr->(index->j) > v: j--)
+      index->(j+1)=index->j;
+    #Ifdef SORTING_STATS;
+    sort_stat_moves=sort_stat_moves+i-j-1;
+    sort_stat_compares=sort_stat_compares+i-j-1+(j>=from);
+    #Endif;
+    index->(j+1)=i;
+  }
+];
+
+[ _hsbi_sub arr index from to   i j l r v vi;
+  if(to<=from)
+    return;
+  l=(to-from+1)/2;
+  r=to-from;
+  for(::) {
+    if(l>0) {
+      l--;
+      vi=index-->(from+l);
+    } else {
+      vi=index-->(from+r);
+      index-->(from+r)=index-->from;
+      if(--r==0) {
+        index-->from=vi;
+        return;
+      }
+    }
+    v=arr->vi;
+    i=l;
+    j=l+l+1;
+    while(j<=r) {
+      #Ifdef SORTING_STATS;
+      sort_stat_compares=sort_stat_compares+1+(j<r);
+      #Endif;
+      if(j<r && arr->(index-->(from+j)) < arr->(index-->(from+j+1)))
+        j++;
+      if(v >= arr->(index-->(from+j)))
+        break;
+      #Ifdef SORTING_STATS;
+      sort_stat_moves++;
+      #Endif;
+      index-->(from+i)=index-->(from+j);
+      i=j;
+      j=j+j+1;
+    }
+    index-->(from+i)=vi;
+  }
+];
+
+[ _qsbi_sub arr index from to depth   i j m temp vm vt p;
   while(from>=0) {
+    if(depth-- == 0)
+      return _hsbi_sub(arr, index, from, to);
+    #Ifdef SORTING_STATS;
+    sort_stat_compares=sort_stat_compares+3;
+    if(_sort_stat_top-depth > sort_stat_depth)
+      sort_stat_depth=_sort_stat_top-depth;
+    #Endif;
     i=from-1;
     j=to;
     m=from+(to-from)/2;
@@ -158,52 +1063,140 @@ Default QUICKSORTLIMIT 10;
         index-->from=temp;
     }
     
+    #Iftrue QUICKSORT3WAY;
+    i=from+1;
+    j=to;
+    m=from;
+    while(i<=j) {
+      vm=index-->i;
+      temp=arr->vm;
+      if(temp<p) {
+        index-->i=index-->m;
+        index-->m=vm;
+        m++;
+        i++;
+      } else if(temp>p) {
+        index-->i=index-->j;
+        index-->j=vm;
+        j--;
+      } else
+        i++;
+    }
+    #Ifdef SORTING_STATS;
+    sort_stat_compares=sort_stat_compares+2*(to-from)-(m-from);
+    sort_stat_moves=sort_stat_moves+2*(m-from+to-j);
+    #Endif;
+
+    if(m-from>to-j) {
+      if(to-j>sort_qs_limit)
+        _qsbi_sub(arr, index, j+1, to, depth);
+      if(m-from>sort_qs_limit)
+        to=m-1;
+      else
+        from=-1;
+    }
+    else {
+      if(m-from>sort_qs_limit)
+        _qsbi_sub(arr, index, from, m-1, depth);
+      if(to-j>sort_qs_limit)
+        from=j+1;
+      else
+        from=-1;
+    }
+    #Ifnot;
     while(++i<=j) {
+      #Ifdef SORTING_STATS;
+      sort_stat_compares++;
+      #Endif;
       if(arr->(index-->i)>p) {
-        while(arr->(index-->j)>p && --j>i);
+        #Ifdef SORTING_STATS;
+        sort_stat_compares++;
+        #Endif;
+        while(arr->(index-->j)>p && --j>i) {
+          #Ifdef SORTING_STATS;
+          sort_stat_compares++;
+          #Endif;
+        }
         if(j>i) {
           temp=index-->j; index-->j=index-->i; index-->i=temp;
+          #Ifdef SORTING_STATS;
+          sort_stat_moves=sort_stat_moves+2;
+          #Endif;
         } else
           i--;
       }
     }
+    #Ifdef SORTING_STATS;
+    sort_stat_moves=sort_stat_moves+2;
+    #Endif;
     i--;
     temp=index-->i;
     index-->i=index-->from;
     index-->from=temp;
 
     if(i-from>to-i) {
-      if(to-i>QUICKSORTLIMIT)
-        _qsbi_sub(arr, index, i+1, to);
-      if(i-from>QUICKSORTLIMIT)
+      if(to-i>sort_qs_limit)
+        _qsbi_sub(arr, index, i+1, to, depth);
+      if(i-from>sort_qs_limit)
         to=i-1;
       else
         from=-1;
     }
     else {    
-      if(i-from>QUICKSORTLIMIT)
-        _qsbi_sub(arr, index, from, i-1);
-      if(to-i>QUICKSORTLIMIT)
+      if(i-from>sort_qs_limit)
+        _qsbi_sub(arr, index, from, i-1, depth);
+      if(to-i>sort_qs_limit)
         from=i+1;
       else
         from=-1;
     }  
+    #Endif;
   }
 ];
 
 [ qsort_bytes_idx arr index from to   i;
+  #Ifndef NOCOUNTSORT;
+  if(to-from>=COUNTSORTLIMIT)
+    return countsort_bytes_idx(arr, index, from, to);
+  #Endif;
   for(i=from:i<=to:i++)
     index-->i=i;
-  _qsbi_sub(arr, index, from, to);
-  #Iftrue QUICKSORTLIMIT > 1;
-  _isbi_sub(arr, index, from, to);
-  #Endif;
+  _qsbi_sub(arr, index, from, to, _qs_depth(to-from+1));
+  if(sort_qs_limit>1)
+    _isbi_sub(arr, index, from, to);
 ];
 
 #Endif; ! Not NOBYTESORT;
 
 #Ifndef NOWORDSORT;
 
+#Ifdef TARGET_GLULX;
+
+[ _iswi_sub arr index from to   i v vi lo hi m len src;
+  for(i=from+1: i<=to: i++) {
+    vi=index-->i;
+    v=arr-->vi;
+    if(arr-->(index-->(i-1)) <= v)
+      continue;
+    lo=from;
+    hi=i-1;
+    while(lo<hi) {
+      m=lo+(hi-lo)/2;
+      if(arr-->(index-->m) > v)
+        hi=m;
+      else
+        lo=m+1;
+    }
+    len=(i-lo)*WORDSIZE;
+    src=index+lo*WORDSIZE;
+    m=src+WORDSIZE;
+    @mcopy len src m;
+    index-->lo=vi;
+  }
+];
+
+#Ifnot;
+
 [ _iswi_sub arr index from to   i j v vi f1;
   f1=from + 1;
   for(i=f1, j=i, vi=index-->i, v=arr-->vi : i<=to : index-->(j+1)=vi, i++, j=i, vi=index-->i, v=arr-->vi )
@@ -211,14 +1204,81 @@ Default QUICKSORTLIMIT 10;
       index-->(j+1)=index-->j;
 ];
 
+#Endif; ! TARGET_GLULX
+
+#Ifdef TARGET_GLULX;
+
+[ _isgi_sub arr index from to comp   i v vi lo hi m len src;
+  for(i=from+1: i<=to: i++) {
+    vi=index-->i;
+    v=arr-->vi;
+    if(~~comp(arr-->(index-->(i-1)), v))
+      continue;
+    lo=from;
+    hi=i-1;
+    while(lo<hi) {
+      m=lo+(hi-lo)/2;
+      if(comp(arr-->(index-->m), v))
+        hi=m;
+      else
+        lo=m+1;
+    }
+    #Ifdef SORTING_STATS;
+    sort_stat_moves=sort_stat_moves+i-lo;
+    #Endif;
+    len=(i-lo)*WORDSIZE;
+    src=index+lo*WORDSIZE;
+    m=src+WORDSIZE;
+    @mcopy len src m;
+    index-->lo=vi;
+  }
+];
+
+#Ifnot;
+
 [ _isgi_sub arr index from to comp   i j v vi f1;
   f1=from + 1;
-  for(i=f1, j=i, vi=index-->i, v=arr-->vi : i<=to : index-->(j+1)=vi, i++, j=i, vi=index-->i, v=arr-->vi )
+  for(i=f1, j=i, vi=index-->i, v=arr-->vi : i<=to : index-->(j+1)=vi, i++, j=i, vi=index-->i, v=arr-->vi ) {
     while(j-- >= f1  && comp(arr-->(index-->j), v))
       index-->(j+1)=index-->j;
+    #Ifdef SORTING_STATS;
+    sort_stat_moves=sort_stat_moves+i-j-1;
+    #Endif;
+  }
+];
+
+#Endif; ! TARGET_GLULX
+
+! Mode-aware InsertionSort core. See _sort_flip.
+[ _ismi_sub arr index from to u d   i j v vi w;
+  for(i=from+1: i<=to: i++) {
+    vi=index-->i;
+    v=arr-->vi+u;
+    if(d)
+      v=~v;
+    for(j=i-1: j>=from: j--) {
+      w=arr-->(index-->j)+u;
+      if(d)
+        w=~w;
+      if(w<=v)
+        break;
+      index-->(j+1)=index-->j;
+    }
+    index-->(j+1)=vi;
+  }
 ];
 
 [ inssort_words_idx arr index from to comp  i;
+  #Ifdef SORTING_STATS;
+  comp=_sort_stat_wrap(comp);
+  #Ifnot;
+  if(comp>0 && comp<_SORT_MODES) {
+    for(i=from:i<=to:i++)
+      index-->i=i;
+    return _ismi_sub(arr, index, from, to,
+      (comp & SORT_UNSIGNED)*_SORT_HIGHBIT, comp & SORT_DESCENDING);
+  }
+  #Endif;
   for(i=from:i<=to:i++)
     index-->i=i;
   if(comp)
@@ -226,8 +1286,83 @@ Default QUICKSORTLIMIT 10;
   _iswi_sub(arr, index, from, to);
 ];
 
-[ _qswi_sub arr index from to   i j m temp vm vt p;
+[ inssort_words_bidx arr index from to comp   i j v w u d;
+  if(to>255) {
+    print "[** Programming error: inssort_words_bidx: to is more than 255 **]^";
+    return;
+  }
+  #Ifdef SORTING_STATS;
+  comp=_sort_stat_wrap(comp);
+  #Ifnot;
+  if(comp>0 && comp<_SORT_MODES) {
+    if(comp & SORT_UNSIGNED)
+      u=_SORT_HIGHBIT;
+    d=comp & SORT_DESCENDING;
+    comp=0;
+  }
+  #Endif;
+  for(i=from: i<=to: i++) {
+    v=arr-->i;
+    if(comp)
+      for(j=i-1: j>=from && comp(arr-->(index->j), v): j--)
+        index->(j+1)=index->j;
+    else {
+      v=v+u;
+      if(d)
+        v=~v;
+      for(j=i-1: j>=from: j--) {
+        w=arr-->(index->j)+u;
+        if(d)
+          w=~w;
+        if(w<=v)
+          break;
+        index->(j+1)=index->j;
+      }
+    }
+    #Ifdef SORTING_STATS;
+    sort_stat_moves=sort_stat_moves+i-j-1;
+    #Endif;
+    index->(j+1)=i;
+  }
+];
+
+[ _hswi_sub arr index from to   i j l r v vi;
+  if(to<=from)
+    return;
+  l=(to-from+1)/2;
+  r=to-from;
+  for(::) {
+    if(l>0) {
+      l--;
+      vi=index-->(from+l);
+    } else {
+      vi=index-->(from+r);
+      index-->(from+r)=index-->from;
+      if(--r==0) {
+        index-->from=vi;
+        return;
+      }
+    }
+    v=arr-->vi;
+    i=l;
+    j=l+l+1;
+    while(j<=r) {
+      if(j<r && arr-->(index-->(from+j)) < arr-->(index-->(from+j+1)))
+        j++;
+      if(v >= arr-->(index-->(from+j)))
+        break;
+      index-->(from+i)=index-->(from+j);
+      i=j;
+      j=j+j+1;
+    }
+    index-->(from+i)=vi;
+  }
+];
+
+[ _qswi_sub arr index from to depth   i j m temp vm vt p;
   while(from>=0) {
+    if(depth-- == 0)
+      return _hswi_sub(arr, index, from, to);
     i=from-1;
     j=to;
     m=from+(to-from)/2;
@@ -246,6 +1381,43 @@ Default QUICKSORTLIMIT 10;
         index-->from=temp;
     }
     
+    #Iftrue QUICKSORT3WAY;
+    i=from+1;
+    j=to;
+    m=from;
+    while(i<=j) {
+      vm=index-->i;
+      temp=arr-->vm;
+      if(temp<p) {
+        index-->i=index-->m;
+        index-->m=vm;
+        m++;
+        i++;
+      } else if(temp>p) {
+        index-->i=index-->j;
+        index-->j=vm;
+        j--;
+      } else
+        i++;
+    }
+
+    if(m-from>to-j) {
+      if(to-j>sort_qs_limit)
+        _qswi_sub(arr, index, j+1, to, depth);
+      if(m-from>sort_qs_limit)
+        to=m-1;
+      else
+        from=-1;
+    }
+    else {
+      if(m-from>sort_qs_limit)
+        _qswi_sub(arr, index, from, m-1, depth);
+      if(to-j>sort_qs_limit)
+        from=j+1;
+      else
+        from=-1;
+    }
+    #Ifnot;
     while(++i<=j) {
       if(arr-->(index-->i)>p) {
         while(arr-->(index-->j)>p && --j>i);
@@ -261,90 +1433,347 @@ Default QUICKSORTLIMIT 10;
     index-->from=temp;
 
     if(i-from>to-i) {
-      if(to-i>QUICKSORTLIMIT)
-        _qswi_sub(arr, index, i+1, to);
-      if(i-from>QUICKSORTLIMIT)
+      if(to-i>sort_qs_limit)
+        _qswi_sub(arr, index, i+1, to, depth);
+      if(i-from>sort_qs_limit)
         to=i-1;
       else
         from=-1;
     }
     else {    
-      if(i-from>QUICKSORTLIMIT)
-        _qswi_sub(arr, index, from, i-1);
-      if(to-i>QUICKSORTLIMIT)
+      if(i-from>sort_qs_limit)
+        _qswi_sub(arr, index, from, i-1, depth);
+      if(to-i>sort_qs_limit)
         from=i+1;
       else
         from=-1;
     }  
+    #Endif;
   }
 ];
 
-[ _qsgi_sub arr index from to comp   i j m temp vm vt p;
+! Mode-aware HeapSort and QuickSort cores. See _sort_flip.
+[ _hsmi_sub arr index from to u d   i j l r v vi w x;
+  if(to<=from)
+    return;
+  l=(to-from+1)/2;
+  r=to-from;
+  for(::) {
+    if(l>0) {
+      l--;
+      vi=index-->(from+l);
+    } else {
+      vi=index-->(from+r);
+      index-->(from+r)=index-->from;
+      if(--r==0) {
+        index-->from=vi;
+        return;
+      }
+    }
+    v=arr-->vi+u;
+    if(d)
+      v=~v;
+    i=l;
+    j=l+l+1;
+    while(j<=r) {
+      w=arr-->(index-->(from+j))+u;
+      if(d)
+        w=~w;
+      if(j<r) {
+        x=arr-->(index-->(from+j+1))+u;
+        if(d)
+          x=~x;
+        if(w<x) {
+          j++;
+          w=x;
+        }
+      }
+      if(v >= w)
+        break;
+      index-->(from+i)=index-->(from+j);
+      i=j;
+      j=j+j+1;
+    }
+    index-->(from+i)=vi;
+  }
+];
+
+[ _qsmi_sub arr index from to depth u d   i j m temp vm vt p;
   while(from>=0) {
+    if(depth-- == 0)
+      return _hsmi_sub(arr, index, from, to, u, d);
     i=from-1;
     j=to;
     m=from+(to-from)/2;
-    p=arr-->(index-->from);
-    vm=arr-->(index-->m);
-    vt=arr-->(index-->to);
-    if(~~(((comp(p,vm)) || comp(vm,vt)) && ((comp(vt,vm)) || comp(vm,p)))) {
+    p=arr-->(index-->from)+u;
+    vm=arr-->(index-->m)+u;
+    vt=arr-->(index-->to)+u;
+    if(d) {
+      p=~p;
+      vm=~vm;
+      vt=~vt;
+    }
+    if((p<=vm && vm<=vt) || (vt<=vm && vm<=p)) {
         p=vm;
         temp=index-->m;
         index-->m=index-->from;
         index-->from=temp;
-    } else if(~~(((comp(p,vt)) || comp(vt,vm)) && ((comp(vm,vt)) || comp(vt,p)))) {
+    } else if((p<=vt && vt<=vm) || (vm<=vt && vt<=p)) {
         p=vt;
         temp=index-->to;
         index-->to=index-->from;
         index-->from=temp;
     }
     
-    while(++i<=j) {
+    #Iftrue QUICKSORT3WAY;
+    i=from+1;
+    j=to;
+    m=from;
+    while(i<=j) {
+      vm=index-->i;
+      temp=arr-->vm+u;
+      if(d)
+        temp=~temp;
+      if(temp<p) {
+        index-->i=index-->m;
+        index-->m=vm;
+        m++;
+        i++;
+      } else if(temp>p) {
+        index-->i=index-->j;
+        index-->j=vm;
+        j--;
+      } else
+        i++;
+    }
+
+    if(m-from>to-j) {
+      if(to-j>sort_qs_limit)
+        _qsmi_sub(arr, index, j+1, to, depth, u, d);
+      if(m-from>sort_qs_limit)
+        to=m-1;
+      else
+        from=-1;
+    }
+    else {
+      if(m-from>sort_qs_limit)
+        _qsmi_sub(arr, index, from, m-1, depth, u, d);
+      if(to-j>sort_qs_limit)
+        from=j+1;
+      else
+        from=-1;
+    }
+    #Ifnot;
+    while(++i<=j) {
+      vt=arr-->(index-->i)+u;
+      if(d)
+        vt=~vt;
+      if(vt>p) {
+        for(::) {
+          vt=arr-->(index-->j)+u;
+          if(d)
+            vt=~vt;
+          if(vt<=p || --j<=i)
+            break;
+        }
+        if(j>i) {
+          temp=index-->j; index-->j=index-->i; index-->i=temp;
+        } else
+          i--;
+      }
+    }
+    i--;
+    temp=index-->i;
+    index-->i=index-->from;
+    index-->from=temp;
+
+    if(i-from>to-i) {
+      if(to-i>sort_qs_limit)
+        _qsmi_sub(arr, index, i+1, to, depth, u, d);
+      if(i-from>sort_qs_limit)
+        to=i-1;
+      else
+        from=-1;
+    }
+    else {    
+      if(i-from>sort_qs_limit)
+        _qsmi_sub(arr, index, from, i-1, depth, u, d);
+      if(to-i>sort_qs_limit)
+        from=i+1;
+      else
+        from=-1;
+    }  
+    #Endif;
+  }
+];
+
+[ _hsgi_sub arr index from to comp   i j l r v vi;
+  if(to<=from)
+    return;
+  l=(to-from+1)/2;
+  r=to-from;
+  for(::) {
+    if(l>0) {
+      l--;
+      vi=index-->(from+l);
+    } else {
+      vi=index-->(from+r);
+      index-->(from+r)=index-->from;
+      if(--r==0) {
+        index-->from=vi;
+        return;
+      }
+    }
+    v=arr-->vi;
+    i=l;
+    j=l+l+1;
+    while(j<=r) {
+      if(j<r && comp(arr-->(index-->(from+j+1)), arr-->(index-->(from+j))))
+        j++;
+      if(~~comp(arr-->(index-->(from+j)), v))
+        break;
+      #Ifdef SORTING_STATS;
+      sort_stat_moves++;
+      #Endif;
+      index-->(from+i)=index-->(from+j);
+      i=j;
+      j=j+j+1;
+    }
+    index-->(from+i)=vi;
+  }
+];
+
+[ _qsgi_sub arr index from to comp depth   i j m temp vm vt p;
+  while(from>=0) {
+    if(depth-- == 0)
+      return _hsgi_sub(arr, index, from, to, comp);
+    #Ifdef SORTING_STATS;
+    if(_sort_stat_top-depth > sort_stat_depth)
+      sort_stat_depth=_sort_stat_top-depth;
+    #Endif;
+    i=from-1;
+    j=to;
+    m=from+(to-from)/2;
+    p=arr-->(index-->from);
+    vm=arr-->(index-->m);
+    vt=arr-->(index-->to);
+    if(~~(((comp(p,vm)) || comp(vm,vt)) && ((comp(vt,vm)) || comp(vm,p)))) {
+        p=vm;
+        temp=index-->m;
+        index-->m=index-->from;
+        index-->from=temp;
+    } else if(~~(((comp(p,vt)) || comp(vt,vm)) && ((comp(vm,vt)) || comp(vt,p)))) {
+        p=vt;
+        temp=index-->to;
+        index-->to=index-->from;
+        index-->from=temp;
+    }
+    
+    #Iftrue QUICKSORT3WAY;
+    i=from+1;
+    j=to;
+    m=from;
+    while(i<=j) {
+      vm=index-->i;
+      temp=arr-->vm;
+      if(comp(p, temp)) {
+        index-->i=index-->m;
+        index-->m=vm;
+        m++;
+        i++;
+      } else if(comp(temp, p)) {
+        index-->i=index-->j;
+        index-->j=vm;
+        j--;
+      } else
+        i++;
+    }
+    #Ifdef SORTING_STATS;
+    sort_stat_moves=sort_stat_moves+2*(m-from+to-j);
+    #Endif;
+
+    if(m-from>to-j) {
+      if(to-j>sort_qs_limit)
+        _qsgi_sub(arr, index, j+1, to, comp, depth);
+      if(m-from>sort_qs_limit)
+        to=m-1;
+      else
+        from=-1;
+    }
+    else {
+      if(m-from>sort_qs_limit)
+        _qsgi_sub(arr, index, from, m-1, comp, depth);
+      if(to-j>sort_qs_limit)
+        from=j+1;
+      else
+        from=-1;
+    }
+    #Ifnot;
+    while(++i<=j) {
       if(comp(arr-->(index-->i),p)) {
         while(comp(arr-->(index-->j),p) && --j>i);
         if(j>i) {
           temp=index-->j; index-->j=index-->i; index-->i=temp;
+          #Ifdef SORTING_STATS;
+          sort_stat_moves=sort_stat_moves+2;
+          #Endif;
         } else
           i--;
       }
     }
+    #Ifdef SORTING_STATS;
+    sort_stat_moves=sort_stat_moves+2;
+    #Endif;
     i--;
     temp=index-->i;
     index-->i=index-->from;
     index-->from=temp;
 
     if(i-from>to-i) {
-      if(to-i>QUICKSORTLIMIT)
-        _qsgi_sub(arr, index, i+1, to, comp);
-      if(i-from>QUICKSORTLIMIT)
+      if(to-i>sort_qs_limit)
+        _qsgi_sub(arr, index, i+1, to, comp, depth);
+      if(i-from>sort_qs_limit)
         to=i-1;
       else
         from=-1;
     }
     else {    
-      if(i-from>QUICKSORTLIMIT)
-        _qsgi_sub(arr, index, from, i-1, comp);
-      if(to-i>QUICKSORTLIMIT)
+      if(i-from>sort_qs_limit)
+        _qsgi_sub(arr, index, from, i-1, comp, depth);
+      if(to-i>sort_qs_limit)
         from=i+1;
       else
         from=-1;
     }  
+    #Endif;
   }
 ];
 
 [ qsort_words_idx arr index from to comp   i;
+  #Ifdef SORTING_STATS;
+  comp=_sort_stat_wrap(comp);
+  #Ifnot;
+  if(comp>0 && comp<_SORT_MODES) {
+    for(i=from:i<=to:i++)
+      index-->i=i;
+    _qsmi_sub(arr, index, from, to, _qs_depth(to-from+1),
+      (comp & SORT_UNSIGNED)*_SORT_HIGHBIT, comp & SORT_DESCENDING);
+    if(sort_qs_limit>1)
+      _ismi_sub(arr, index, from, to, (comp & SORT_UNSIGNED)*_SORT_HIGHBIT,
+        comp & SORT_DESCENDING);
+    return;
+  }
+  #Endif;
   for(i=from:i<=to:i++)
     index-->i=i;
   if(comp) {
-    _qsgi_sub(arr, index, from, to, comp);
-    #Iftrue QUICKSORTLIMIT > 1;
-    _isgi_sub(arr, index, from, to, comp);
-    #Endif;
+    _qsgi_sub(arr, index, from, to, comp, _qs_depth(to-from+1));
+    if(sort_qs_limit>1)
+      _isgi_sub(arr, index, from, to, comp);
   } else {
-    _qswi_sub(arr, index, from, to);
-    #Iftrue QUICKSORTLIMIT > 1;
-    _iswi_sub(arr, index, from, to);
-    #Endif;
+    _qswi_sub(arr, index, from, to, _qs_depth(to-from+1));
+    if(sort_qs_limit>1)
+      _iswi_sub(arr, index, from, to);
   }
 ];
 
@@ -360,15 +1789,102 @@ Default QUICKSORTLIMIT 10;
 
 #Ifndef NOBYTESORT;
 
+#Ifdef TARGET_GLULX;
+
+[ inssort_bytes arr from to   i v lo hi m len src;
+  for(i=from+1: i<=to: i++) {
+    v=arr->i;
+    #Ifdef SORTING_STATS;
+    sort_stat_compares++;
+    #Endif;
+    if(arr->(i-1) <= v)
+      continue;
+    lo=from;
+    hi=i-1;
+    while(lo<hi) {
+      m=lo+(hi-lo)/2;
+      #Ifdef SORTING_STATS;
+      sort_stat_compares++;
+      #Endif;
+      if(arr->m > v)
+        hi=m;
+      else
+        lo=m+1;
+    }
+    #Ifdef SORTING_STATS;
+    sort_stat_moves=sort_stat_moves+i-lo;
+    #Endif;
+    len=i-lo;
+    src=arr+lo;
+    m=src+1;
+    @mcopy len src m;
+    arr->lo=v;
+  }
+];
+
+#Ifnot;
+
 [ inssort_bytes arr from to   i j v f1;
   f1=from + 1;
-  for(i=f1, j=i, v=arr->i : i<=to : arr->(j+1)=v, i++, j=i, v=arr->i)
+  for(i=f1, j=i, v=arr->i : i<=to : arr->(j+1)=v, i++, j=i, v=arr->i) {
     while(j-- >= f1  && arr->j > v)
       arr->(j+1)=arr->j;
+    #Ifdef SORTING_STATS;
+    sort_stat_moves=sort_stat_moves+i-j-1;
+    sort_stat_compares=sort_stat_compares+i-j-1+(j>=from);
+    #Endif;
+  }
+];
+
+#Endif; ! TARGET_GLULX
+
+[ _hsb_sub arr from to   i j l r v;
+  if(to<=from)
+    return;
+  l=(to-from+1)/2;
+  r=to-from;
+  for(::) {
+    if(l>0) {
+      l--;
+      v=arr->(from+l);
+    } else {
+      v=arr->(from+r);
+      arr->(from+r)=arr->from;
+      if(--r==0) {
+        arr->from=v;
+        return;
+      }
+    }
+    i=l;
+    j=l+l+1;
+    while(j<=r) {
+      #Ifdef SORTING_STATS;
+      sort_stat_compares=sort_stat_compares+1+(j<r);
+      #Endif;
+      if(j<r && arr->(from+j) < arr->(from+j+1))
+        j++;
+      if(v >= arr->(from+j))
+        break;
+      #Ifdef SORTING_STATS;
+      sort_stat_moves++;
+      #Endif;
+      arr->(from+i)=arr->(from+j);
+      i=j;
+      j=j+j+1;
+    }
+    arr->(from+i)=v;
+  }
 ];
 
-[ _qsb_sub arr from to   i j m temp vm vt p;
+[ _qsb_sub arr from to depth   i j m temp vm vt p;
   while(from>=0) {
+    if(depth-- == 0)
+      return _hsb_sub(arr, from, to);
+    #Ifdef SORTING_STATS;
+    sort_stat_compares=sort_stat_compares+3;
+    if(_sort_stat_top-depth > sort_stat_depth)
+      sort_stat_depth=_sort_stat_top-depth;
+    #Endif;
     i=from-1;
     j=to;
     m=from+(to-from)/2;
@@ -387,58 +1903,199 @@ Default QUICKSORTLIMIT 10;
         arr->from=temp;
     }
     
+    #Iftrue QUICKSORT3WAY;
+    i=from+1;
+    j=to;
+    m=from;
+    while(i<=j) {
+      vm=arr->i;
+      if(vm<p) {
+        arr->i=arr->m;
+        arr->m=vm;
+        m++;
+        i++;
+      } else if(vm>p) {
+        arr->i=arr->j;
+        arr->j=vm;
+        j--;
+      } else
+        i++;
+    }
+    #Ifdef SORTING_STATS;
+    sort_stat_compares=sort_stat_compares+2*(to-from)-(m-from);
+    sort_stat_moves=sort_stat_moves+2*(m-from+to-j);
+    #Endif;
+
+    if(m-from>to-j) {
+      if(to-j>sort_qs_limit)
+        _qsb_sub(arr, j+1, to, depth);
+      if(m-from>sort_qs_limit)
+        to=m-1;
+      else
+        from=-1;
+    }
+    else {
+      if(m-from>sort_qs_limit)
+        _qsb_sub(arr, from, m-1, depth);
+      if(to-j>sort_qs_limit)
+        from=j+1;
+      else
+        from=-1;
+    }
+    #Ifnot;
     while(++i<=j) {
+      #Ifdef SORTING_STATS;
+      sort_stat_compares++;
+      #Endif;
       if(arr->i > p) {
-        while(arr->j > p && --j>i);
+        #Ifdef SORTING_STATS;
+        sort_stat_compares++;
+        #Endif;
+        while(arr->j > p && --j>i) {
+          #Ifdef SORTING_STATS;
+          sort_stat_compares++;
+          #Endif;
+        }
         if(j>i) {
           temp=arr->j; arr->j=arr->i; arr->i=temp;
+          #Ifdef SORTING_STATS;
+          sort_stat_moves=sort_stat_moves+2;
+          #Endif;
         } else
           i--;
       }
     }
+    #Ifdef SORTING_STATS;
+    sort_stat_moves=sort_stat_moves+2;
+    #Endif;
     i--;
     temp=arr->i;
     arr->i=arr->from;
     arr->from=temp;
 
     if(i-from>to-i) {
-      if(to-i>QUICKSORTLIMIT)
-        _qsb_sub(arr, i+1, to);
-      if(i-from>QUICKSORTLIMIT)
+      if(to-i>sort_qs_limit)
+        _qsb_sub(arr, i+1, to, depth);
+      if(i-from>sort_qs_limit)
         to=i-1;
       else
         from=-1;
     }
     else {    
-      if(i-from>QUICKSORTLIMIT)
-        _qsb_sub(arr, from, i-1);
-      if(to-i>QUICKSORTLIMIT)
+      if(i-from>sort_qs_limit)
+        _qsb_sub(arr, from, i-1, depth);
+      if(to-i>sort_qs_limit)
         from=i+1;
       else
         from=-1;
     }  
+    #Endif;
   }
 ];
 
 [ qsort_bytes arr from to;
-  _qsb_sub(arr, from, to);
-  #Iftrue QUICKSORTLIMIT > 1;
-  inssort_bytes(arr, from, to);
+  #Ifndef NOCOUNTSORT;
+  if(to-from>=COUNTSORTLIMIT)
+    return countsort_bytes(arr, from, to);
   #Endif;
+  _qsb_sub(arr, from, to, _qs_depth(to-from+1));
+  if(sort_qs_limit>1)
+    inssort_bytes(arr, from, to);
 ];
 
 #Endif; ! Not NOBYTESORT;
 
 #Ifndef NOWORDSORT;
 
+#Ifdef TARGET_GLULX;
+
+[ _isg_sub arr from to comp   i v lo hi m len src;
+  for(i=from+1: i<=to: i++) {
+    v=arr-->i;
+    if(~~comp(arr-->(i-1), v))
+      continue;
+    lo=from;
+    hi=i-1;
+    while(lo<hi) {
+      m=lo+(hi-lo)/2;
+      if(comp(arr-->m, v))
+        hi=m;
+      else
+        lo=m+1;
+    }
+    #Ifdef SORTING_STATS;
+    sort_stat_moves=sort_stat_moves+i-lo;
+    #Endif;
+    len=(i-lo)*WORDSIZE;
+    src=arr+lo*WORDSIZE;
+    m=src+WORDSIZE;
+    @mcopy len src m;
+    arr-->lo=v;
+  }
+];
+
+#Ifnot;
+
 [ _isg_sub arr from to comp   i j v f1;
   f1=from + 1;
-  for(i=f1, j=i, v=arr-->i : i<=to : arr-->(j+1)=v, i++, j=i, v=arr-->i)
+  for(i=f1, j=i, v=arr-->i : i<=to : arr-->(j+1)=v, i++, j=i, v=arr-->i) {
     while(j-- >= f1  && comp(arr-->j, v))
       arr-->(j+1)=arr-->j;
+    #Ifdef SORTING_STATS;
+    sort_stat_moves=sort_stat_moves+i-j-1;
+    #Endif;
+  }
+];
+
+#Endif; ! TARGET_GLULX
+
+#Ifdef TARGET_GLULX;
+
+[ inssort_words arr from to comp   i v lo hi m len src;
+  if(comp>0 && comp<_SORT_MODES) {
+    _sort_flip(arr, from, to, comp);
+    inssort_words(arr, from, to);
+    _sort_flip(arr, from, to, comp);
+    return;
+  }
+  #Ifdef SORTING_STATS;
+  comp=_sort_stat_wrap(comp);
+  #Endif;
+  if(comp)
+    return _isg_sub(arr, from, to, comp);
+  for(i=from+1: i<=to: i++) {
+    v=arr-->i;
+    if(arr-->(i-1) <= v)
+      continue;
+    lo=from;
+    hi=i-1;
+    while(lo<hi) {
+      m=lo+(hi-lo)/2;
+      if(arr-->m > v)
+        hi=m;
+      else
+        lo=m+1;
+    }
+    len=(i-lo)*WORDSIZE;
+    src=arr+lo*WORDSIZE;
+    m=src+WORDSIZE;
+    @mcopy len src m;
+    arr-->lo=v;
+  }
 ];
 
+#Ifnot;
+
 [ inssort_words arr from to comp   i j v f1;
+  if(comp>0 && comp<_SORT_MODES) {
+    _sort_flip(arr, from, to, comp);
+    inssort_words(arr, from, to);
+    _sort_flip(arr, from, to, comp);
+    return;
+  }
+  #Ifdef SORTING_STATS;
+  comp=_sort_stat_wrap(comp);
+  #Endif;
   if(comp)
     return _isg_sub(arr, from, to, comp);
   f1=from + 1;
@@ -447,8 +2104,44 @@ Default QUICKSORTLIMIT 10;
       arr-->(j+1)=arr-->j;
 ];
 
-[ _qsw_sub arr from to   i j m temp vm vt p;
+#Endif; ! TARGET_GLULX
+
+[ _hsw_sub arr from to   i j l r v;
+  if(to<=from)
+    return;
+  l=(to-from+1)/2;
+  r=to-from;
+  for(::) {
+    if(l>0) {
+      l--;
+      v=arr-->(from+l);
+    } else {
+      v=arr-->(from+r);
+      arr-->(from+r)=arr-->from;
+      if(--r==0) {
+        arr-->from=v;
+        return;
+      }
+    }
+    i=l;
+    j=l+l+1;
+    while(j<=r) {
+      if(j<r && arr-->(from+j) < arr-->(from+j+1))
+        j++;
+      if(v >= arr-->(from+j))
+        break;
+      arr-->(from+i)=arr-->(from+j);
+      i=j;
+      j=j+j+1;
+    }
+    arr-->(from+i)=v;
+  }
+];
+
+[ _qsw_sub arr from to depth   i j m temp vm vt p;
   while(from>=0) {
+    if(depth-- == 0)
+      return _hsw_sub(arr, from, to);
     i=from-1;
     j=to;
     m=from+(to-from)/2;
@@ -467,6 +2160,42 @@ Default QUICKSORTLIMIT 10;
         arr-->from=temp;
     }
     
+    #Iftrue QUICKSORT3WAY;
+    i=from+1;
+    j=to;
+    m=from;
+    while(i<=j) {
+      vm=arr-->i;
+      if(vm<p) {
+        arr-->i=arr-->m;
+        arr-->m=vm;
+        m++;
+        i++;
+      } else if(vm>p) {
+        arr-->i=arr-->j;
+        arr-->j=vm;
+        j--;
+      } else
+        i++;
+    }
+
+    if(m-from>to-j) {
+      if(to-j>sort_qs_limit)
+        _qsw_sub(arr, j+1, to, depth);
+      if(m-from>sort_qs_limit)
+        to=m-1;
+      else
+        from=-1;
+    }
+    else {
+      if(m-from>sort_qs_limit)
+        _qsw_sub(arr, from, m-1, depth);
+      if(to-j>sort_qs_limit)
+        from=j+1;
+      else
+        from=-1;
+    }
+    #Ifnot;
     while(++i<=j) {
       if(arr-->i > p) {
         while(arr-->j > p && --j>i);
@@ -482,26 +2211,68 @@ Default QUICKSORTLIMIT 10;
     arr-->from=temp;
 
     if(i-from>to-i) {
-      if(to-i>QUICKSORTLIMIT)
-        _qsw_sub(arr, i+1, to);
-      if(i-from>QUICKSORTLIMIT)
+      if(to-i>sort_qs_limit)
+        _qsw_sub(arr, i+1, to, depth);
+      if(i-from>sort_qs_limit)
         to=i-1;
       else
         from=-1;
     }
     else {    
-      if(i-from>QUICKSORTLIMIT)
-        _qsw_sub(arr, from, i-1);
-      if(to-i>QUICKSORTLIMIT)
+      if(i-from>sort_qs_limit)
+        _qsw_sub(arr, from, i-1, depth);
+      if(to-i>sort_qs_limit)
         from=i+1;
       else
         from=-1;
     }  
+    #Endif;
+  }
+];
+
+[ _hsg_sub arr from to comp   i j l r v;
+  if(to<=from)
+    return;
+  l=(to-from+1)/2;
+  r=to-from;
+  for(::) {
+    if(l>0) {
+      l--;
+      v=arr-->(from+l);
+    } else {
+      v=arr-->(from+r);
+      arr-->(from+r)=arr-->from;
+      if(--r==0) {
+        arr-->from=v;
+        return;
+      }
+    }
+    i=l;
+    j=l+l+1;
+    while(j<=r) {
+      if(j<r && comp(arr-->(from+j+1), arr-->(from+j)))
+        j++;
+      if(~~comp(arr-->(from+j), v))
+        break;
+      #Ifdef SORTING_STATS;
+      sort_stat_moves++;
+      #Endif;
+      arr-->(from+i)=arr-->(from+j);
+      i=j;
+      j=j+j+1;
+    }
+    arr-->(from+i)=v;
   }
 ];
 
-[ _qsg_sub arr from to comp   i j m temp vm vt p;
+[ _qsg_sub arr from to comp depth   i j m temp vm vt p;
   while(from>=0) {
+    if(depth-- == 0)
+      return _hsg_sub(arr, from, to, comp);
+    #Ifdef SORTING_STATS;
+    if(_sort_stat_top-depth > sort_stat_depth)
+      sort_stat_depth=_sort_stat_top-depth;
+    #Endif;
     i=from-1;
     j=to;
     m=from+(to-from)/2;
@@ -520,50 +2291,103 @@ Default QUICKSORTLIMIT 10;
         arr-->from=temp;
     }
     
+    #Iftrue QUICKSORT3WAY;
+    i=from+1;
+    j=to;
+    m=from;
+    while(i<=j) {
+      vm=arr-->i;
+      if(comp(p, vm)) {
+        arr-->i=arr-->m;
+        arr-->m=vm;
+        m++;
+        i++;
+      } else if(comp(vm, p)) {
+        arr-->i=arr-->j;
+        arr-->j=vm;
+        j--;
+      } else
+        i++;
+    }
+    #Ifdef SORTING_STATS;
+    sort_stat_moves=sort_stat_moves+2*(m-from+to-j);
+    #Endif;
+
+    if(m-from>to-j) {
+      if(to-j>sort_qs_limit)
+        _qsg_sub(arr, j+1, to, comp, depth);
+      if(m-from>sort_qs_limit)
+        to=m-1;
+      else
+        from=-1;
+    }
+    else {
+      if(m-from>sort_qs_limit)
+        _qsg_sub(arr, from, m-1, comp, depth);
+      if(to-j>sort_qs_limit)
+        from=j+1;
+      else
+        from=-1;
+    }
+    #Ifnot;
     while(++i<=j) {
       if(comp(arr-->i,p)) {
         while(comp(arr-->j,p) && --j>i);
         if(j>i) {
           temp=arr-->j; arr-->j=arr-->i; arr-->i=temp;
+          #Ifdef SORTING_STATS;
+          sort_stat_moves=sort_stat_moves+2;
+          #Endif;
         } else
           i--;
       }
     }
+    #Ifdef SORTING_STATS;
+    sort_stat_moves=sort_stat_moves+2;
+    #Endif;
     i--;
     temp=arr-->i;
     arr-->i=arr-->from;
     arr-->from=temp;
 
     if(i-from>to-i) {
-      if(to-i>QUICKSORTLIMIT)
-        _qsg_sub(arr, i+1, to, comp);
-      if(i-from>QUICKSORTLIMIT)
+      if(to-i>sort_qs_limit)
+        _qsg_sub(arr, i+1, to, comp, depth);
+      if(i-from>sort_qs_limit)
         to=i-1;
       else
         from=-1;
     }
     else {    
-      if(i-from>QUICKSORTLIMIT)
-        _qsg_sub(arr, from, i-1, comp);
-      if(to-i>QUICKSORTLIMIT)
+      if(i-from>sort_qs_limit)
+        _qsg_sub(arr, from, i-1, comp, depth);
+      if(to-i>sort_qs_limit)
         from=i+1;
       else
         from=-1;
     }  
+    #Endif;
   }
 ];
 
 [ qsort_words arr from to comp;
+  if(comp>0 && comp<_SORT_MODES) {
+    _sort_flip(arr, from, to, comp);
+    qsort_words(arr, from, to);
+    _sort_flip(arr, from, to, comp);
+    return;
+  }
+  #Ifdef SORTING_STATS;
+  comp=_sort_stat_wrap(comp);
+  #Endif;
   if(comp) {
-    _qsg_sub(arr, from, to, comp);
-    #Iftrue QUICKSORTLIMIT > 1;
-    _isg_sub(arr, from, to, comp);
-    #Endif;
+    _qsg_sub(arr, from, to, comp, _qs_depth(to-from+1));
+    if(sort_qs_limit>1)
+      _isg_sub(arr, from, to, comp);
   } else {
-    _qsw_sub(arr, from, to);
-    #Iftrue QUICKSORTLIMIT > 1;
-    inssort_words(arr, from, to);
-    #Endif;
+    _qsw_sub(arr, from, to, _qs_depth(to-from+1));
+    if(sort_qs_limit>1)
+      inssort_words(arr, from, to);
   }
 ];
 
@@ -571,146 +2395,3241 @@ Default QUICKSORTLIMIT 10;
 
 #Endif; ! Not NODIRECTSORT
 
-#Endif; ! Not NOQUICKSORT
-
-
-
-
-#Ifndef NOSHELLSORT;
-
-Default SHELLSORTCONST 3;
-
 !!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!
-! Index-based ShellSort routines.
+! Selection routines (QuickSelect).
 !!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!
 
+! The selection cores partition three ways around a median-of-three pivot,
+! and then carry on only with the part that holds position k. They share
+! the depth budget and the HeapSort fallback of the QuickSort cores.
+
+#Ifndef NOSELECTION;
+
 #Ifndef NOINDEXSORT;
 
 #Ifndef NOBYTESORT;
 
-[ shsort_bytes_idx arr index from to   i vi j v h k len;
-  h=1;
-  len=to-from+1;
-  while(h < len)
-    h=SHELLSORTCONST*h+1;
+[ _selbi_sub arr index from to k depth   i j m p vm vt;
+  while(to-from>sort_qs_limit) {
+    if(depth-- == 0)
+      return _hsbi_sub(arr, index, from, to);
+    #Ifdef SORTING_STATS;
+    sort_stat_compares=sort_stat_compares+3;
+    if(_sort_stat_top-depth > sort_stat_depth)
+      sort_stat_depth=_sort_stat_top-depth;
+    #Endif;
+    m=from+(to-from)/2;
+    p=arr->(index-->from);
+    vm=arr->(index-->m);
+    vt=arr->(index-->to);
+    if((p<=vm && vm<=vt) || (vt<=vm && vm<=p))
+      p=vm;
+    else if((p<=vt && vt<=vm) || (vm<=vt && vt<=p))
+      p=vt;
+    i=from;
+    j=to;
+    m=from;
+    while(i<=j) {
+      vm=index-->i;
+      vt=arr->vm;
+      if(vt<p) {
+        index-->i=index-->m;
+        index-->m=vm;
+        m++;
+        i++;
+      } else if(vt>p) {
+        index-->i=index-->j;
+        index-->j=vm;
+        j--;
+      } else
+        i++;
+    }
+    #Ifdef SORTING_STATS;
+    sort_stat_compares=sort_stat_compares+2*(to-from+1)-(m-from);
+    sort_stat_moves=sort_stat_moves+2*(m-from+to-j);
+    #Endif;
+    if(k<m)
+      to=m-1;
+    else if(k>j)
+      from=j+1;
+    else
+      return;
+  }
+  _isbi_sub(arr, index, from, to);
+];
+
+[ nth_bytes_idx arr index from to k   i;
   for(i=from:i<=to:i++)
     index-->i=i;
-  while((h=(h-1)/SHELLSORTCONST)>=1)
-    for(k=0: k<h: k++)
-      for(i=k+h+from: i<=to: i=i+h) {
-        j=i;
-        vi=index-->i;
-        v=arr->vi;
-        while((j=j-h) >= from && arr->(index-->j) > v)
-            index-->(j+h)=index-->j;
-        index-->(j+h)=vi;
-      }
+  _selbi_sub(arr, index, from, to, k, _qs_depth(to-from+1));
+];
+
+[ partial_sort_bytes_idx arr index from to k;
+  nth_bytes_idx(arr, index, from, to, k);
+  _qsbi_sub(arr, index, from, k-1, _qs_depth(k-from));
+  if(sort_qs_limit>1)
+    _isbi_sub(arr, index, from, k-1);
 ];
 
 #Endif; ! Not NOBYTESORT;
 
 #Ifndef NOWORDSORT;
 
-[ _ssgi_sub arr index from to comp h   i vi j v k;
-  while((h=(h-1)/SHELLSORTCONST)>=1)
-    for(k=0: k<h: k++)
-      for(i=k+h+from: i<=to: i=i+h) {
-        j=i;
-        vi=index-->i;
-        v=arr-->vi;
-        while((j=j-h) >= from && comp(arr-->(index-->j), v))
-            index-->(j+h)=index-->j;
-        index-->(j+h)=vi;
-      }
+[ _selwi_sub arr index from to k depth   i j m p vm vt;
+  while(to-from>sort_qs_limit) {
+    if(depth-- == 0)
+      return _hswi_sub(arr, index, from, to);
+    m=from+(to-from)/2;
+    p=arr-->(index-->from);
+    vm=arr-->(index-->m);
+    vt=arr-->(index-->to);
+    if((p<=vm && vm<=vt) || (vt<=vm && vm<=p))
+      p=vm;
+    else if((p<=vt && vt<=vm) || (vm<=vt && vt<=p))
+      p=vt;
+    i=from;
+    j=to;
+    m=from;
+    while(i<=j) {
+      vm=index-->i;
+      vt=arr-->vm;
+      if(vt<p) {
+        index-->i=index-->m;
+        index-->m=vm;
+        m++;
+        i++;
+      } else if(vt>p) {
+        index-->i=index-->j;
+        index-->j=vm;
+        j--;
+      } else
+        i++;
+    }
+    if(k<m)
+      to=m-1;
+    else if(k>j)
+      from=j+1;
+    else
+      return;
+  }
+  _iswi_sub(arr, index, from, to);
 ];
 
-[ shsort_words_idx arr index from to comp   h i vi j v k len;
+! Mode-aware selection core. mode is passed whole, and split into u and d
+! here, since there is no room for both among the arguments.
+[ _selmi_sub arr index from to k depth mode   i j m p vm vt u d;
+  u=(mode & SORT_UNSIGNED)*_SORT_HIGHBIT;
+  d=mode & SORT_DESCENDING;
+  while(to-from>sort_qs_limit) {
+    if(depth-- == 0)
+      return _hsmi_sub(arr, index, from, to, u, d);
+    m=from+(to-from)/2;
+    p=arr-->(index-->from)+u;
+    vm=arr-->(index-->m)+u;
+    vt=arr-->(index-->to)+u;
+    if(d) {
+      p=~p;
+      vm=~vm;
+      vt=~vt;
+    }
+    if((p<=vm && vm<=vt) || (vt<=vm && vm<=p))
+      p=vm;
+    else if((p<=vt && vt<=vm) || (vm<=vt && vt<=p))
+      p=vt;
+    i=from;
+    j=to;
+    m=from;
+    while(i<=j) {
+      vm=index-->i;
+      vt=arr-->vm+u;
+      if(d)
+        vt=~vt;
+      if(vt<p) {
+        index-->i=index-->m;
+        index-->m=vm;
+        m++;
+        i++;
+      } else if(vt>p) {
+        index-->i=index-->j;
+        index-->j=vm;
+        j--;
+      } else
+        i++;
+    }
+    if(k<m)
+      to=m-1;
+    else if(k>j)
+      from=j+1;
+    else
+      return;
+  }
+  _ismi_sub(arr, index, from, to, u, d);
+];
+
+[ _selgi_sub arr index from to k comp depth   i j m p vm vt;
+  while(to-from>sort_qs_limit) {
+    if(depth-- == 0)
+      return _hsgi_sub(arr, index, from, to, comp);
+    #Ifdef SORTING_STATS;
+    if(_sort_stat_top-depth > sort_stat_depth)
+      sort_stat_depth=_sort_stat_top-depth;
+    #Endif;
+    m=from+(to-from)/2;
+    p=arr-->(index-->from);
+    vm=arr-->(index-->m);
+    vt=arr-->(index-->to);
+    if(~~(((comp(p,vm)) || comp(vm,vt)) && ((comp(vt,vm)) || comp(vm,p))))
+      p=vm;
+    else if(~~(((comp(p,vt)) || comp(vt,vm)) && ((comp(vm,vt)) || comp(vt,p))))
+      p=vt;
+    i=from;
+    j=to;
+    m=from;
+    while(i<=j) {
+      vm=index-->i;
+      vt=arr-->vm;
+      if(comp(p, vt)) {
+        index-->i=index-->m;
+        index-->m=vm;
+        m++;
+        i++;
+      } else if(comp(vt, p)) {
+        index-->i=index-->j;
+        index-->j=vm;
+        j--;
+      } else
+        i++;
+    }
+    #Ifdef SORTING_STATS;
+    sort_stat_moves=sort_stat_moves+2*(m-from+to-j);
+    #Endif;
+    if(k<m)
+      to=m-1;
+    else if(k>j)
+      from=j+1;
+    else
+      return;
+  }
+  _isgi_sub(arr, index, from, to, comp);
+];
+
+[ nth_words_idx arr index from to k comp   i;
   for(i=from:i<=to:i++)
     index-->i=i;
-  h=1;
-  len=to-from+1;
-  while(h < len)
-    h=SHELLSORTCONST*h+1;
+  #Ifdef SORTING_STATS;
+  comp=_sort_stat_wrap(comp);
+  #Ifnot;
+  if(comp>0 && comp<_SORT_MODES)
+    return _selmi_sub(arr, index, from, to, k, _qs_depth(to-from+1), comp);
+  #Endif;
   if(comp)
-    return _ssgi_sub(arr, index, from, to, comp, h);
-  while((h=(h-1)/SHELLSORTCONST)>=1)
-    for(k=0: k<h: k++)
-      for(i=k+h+from: i<=to: i=i+h) {
-        j=i;
-        vi=index-->i;
-        v=arr-->vi;
-        while((j=j-h) >= from && arr-->(index-->j) > v)
-            index-->(j+h)=index-->j;
-        index-->(j+h)=vi;
-      }
+    return _selgi_sub(arr, index, from, to, k, comp, _qs_depth(to-from+1));
+  _selwi_sub(arr, index, from, to, k, _qs_depth(to-from+1));
+];
+
+[ partial_sort_words_idx arr index from to k comp;
+  nth_words_idx(arr, index, from, to, k, comp);
+  #Ifdef SORTING_STATS;
+  comp=_sort_stat_wrap(comp);
+  #Ifnot;
+  if(comp>0 && comp<_SORT_MODES) {
+    _qsmi_sub(arr, index, from, k-1, _qs_depth(k-from),
+      (comp & SORT_UNSIGNED)*_SORT_HIGHBIT, comp & SORT_DESCENDING);
+    if(sort_qs_limit>1)
+      _ismi_sub(arr, index, from, k-1, (comp & SORT_UNSIGNED)*_SORT_HIGHBIT,
+        comp & SORT_DESCENDING);
+    return;
+  }
+  #Endif;
+  if(comp) {
+    _qsgi_sub(arr, index, from, k-1, comp, _qs_depth(k-from));
+    if(sort_qs_limit>1)
+      _isgi_sub(arr, index, from, k-1, comp);
+  } else {
+    _qswi_sub(arr, index, from, k-1, _qs_depth(k-from));
+    if(sort_qs_limit>1)
+      _iswi_sub(arr, index, from, k-1);
+  }
 ];
 
 #Endif; ! Not NOWORDSORT;
 
 #Endif; ! Not NOINDEXSORT;
 
+#Ifndef NODIRECTSORT;
+
+#Ifndef NOBYTESORT;
+
+[ _selb_sub arr from to k depth   i j m p vm vt;
+  while(to-from>sort_qs_limit) {
+    if(depth-- == 0)
+      return _hsb_sub(arr, from, to);
+    #Ifdef SORTING_STATS;
+    sort_stat_compares=sort_stat_compares+3;
+    if(_sort_stat_top-depth > sort_stat_depth)
+      sort_stat_depth=_sort_stat_top-depth;
+    #Endif;
+    m=from+(to-from)/2;
+    p=arr->from;
+    vm=arr->m;
+    vt=arr->to;
+    if((p<=vm && vm<=vt) || (vt<=vm && vm<=p))
+      p=vm;
+    else if((p<=vt && vt<=vm) || (vm<=vt && vt<=p))
+      p=vt;
+    i=from;
+    j=to;
+    m=from;
+    while(i<=j) {
+      vm=arr->i;
+      if(vm<p) {
+        arr->i=arr->m;
+        arr->m=vm;
+        m++;
+        i++;
+      } else if(vm>p) {
+        arr->i=arr->j;
+        arr->j=vm;
+        j--;
+      } else
+        i++;
+    }
+    #Ifdef SORTING_STATS;
+    sort_stat_compares=sort_stat_compares+2*(to-from+1)-(m-from);
+    sort_stat_moves=sort_stat_moves+2*(m-from+to-j);
+    #Endif;
+    if(k<m)
+      to=m-1;
+    else if(k>j)
+      from=j+1;
+    else
+      return;
+  }
+  inssort_bytes(arr, from, to);
+];
+
+[ nth_bytes arr from to k;
+  _selb_sub(arr, from, to, k, _qs_depth(to-from+1));
+];
+
+[ partial_sort_bytes arr from to k;
+  nth_bytes(arr, from, to, k);
+  qsort_bytes(arr, from, k-1);
+];
+
+[ top_bytes arr from to n;
+  nth_bytes(arr, from, to, to-n+1);
+  qsort_bytes(arr, to-n+2, to);
+];
+
+#Endif; ! Not NOBYTESORT;
+
+#Ifndef NOWORDSORT;
+
+[ _selw_sub arr from to k depth   i j m p vm vt;
+  while(to-from>sort_qs_limit) {
+    if(depth-- == 0)
+      return _hsw_sub(arr, from, to);
+    m=from+(to-from)/2;
+    p=arr-->from;
+    vm=arr-->m;
+    vt=arr-->to;
+    if((p<=vm && vm<=vt) || (vt<=vm && vm<=p))
+      p=vm;
+    else if((p<=vt && vt<=vm) || (vm<=vt && vt<=p))
+      p=vt;
+    i=from;
+    j=to;
+    m=from;
+    while(i<=j) {
+      vm=arr-->i;
+      if(vm<p) {
+        arr-->i=arr-->m;
+        arr-->m=vm;
+        m++;
+        i++;
+      } else if(vm>p) {
+        arr-->i=arr-->j;
+        arr-->j=vm;
+        j--;
+      } else
+        i++;
+    }
+    if(k<m)
+      to=m-1;
+    else if(k>j)
+      from=j+1;
+    else
+      return;
+  }
+  inssort_words(arr, from, to);
+];
+
+[ _selg_sub arr from to k comp depth   i j m p vm vt;
+  while(to-from>sort_qs_limit) {
+    if(depth-- == 0)
+      return _hsg_sub(arr, from, to, comp);
+    #Ifdef SORTING_STATS;
+    if(_sort_stat_top-depth > sort_stat_depth)
+      sort_stat_depth=_sort_stat_top-depth;
+    #Endif;
+    m=from+(to-from)/2;
+    p=arr-->from;
+    vm=arr-->m;
+    vt=arr-->to;
+    if(~~(((comp(p,vm)) || comp(vm,vt)) && ((comp(vt,vm)) || comp(vm,p))))
+      p=vm;
+    else if(~~(((comp(p,vt)) || comp(vt,vm)) && ((comp(vm,vt)) || comp(vt,p))))
+      p=vt;
+    i=from;
+    j=to;
+    m=from;
+    while(i<=j) {
+      vm=arr-->i;
+      if(comp(p, vm)) {
+        arr-->i=arr-->m;
+        arr-->m=vm;
+        m++;
+        i++;
+      } else if(comp(vm, p)) {
+        arr-->i=arr-->j;
+        arr-->j=vm;
+        j--;
+      } else
+        i++;
+    }
+    #Ifdef SORTING_STATS;
+    sort_stat_moves=sort_stat_moves+2*(m-from+to-j);
+    #Endif;
+    if(k<m)
+      to=m-1;
+    else if(k>j)
+      from=j+1;
+    else
+      return;
+  }
+  _isg_sub(arr, from, to, comp);
+];
+
+[ nth_words arr from to k comp;
+  if(comp>0 && comp<_SORT_MODES) {
+    _sort_flip(arr, from, to, comp);
+    nth_words(arr, from, to, k);
+    _sort_flip(arr, from, to, comp);
+    return;
+  }
+  #Ifdef SORTING_STATS;
+  comp=_sort_stat_wrap(comp);
+  #Endif;
+  if(comp)
+    return _selg_sub(arr, from, to, k, comp, _qs_depth(to-from+1));
+  _selw_sub(arr, from, to, k, _qs_depth(to-from+1));
+];
+
+[ partial_sort_words arr from to k comp;
+  if(comp>0 && comp<_SORT_MODES) {
+    _sort_flip(arr, from, to, comp);
+    partial_sort_words(arr, from, to, k);
+    _sort_flip(arr, from, to, comp);
+    return;
+  }
+  #Ifdef SORTING_STATS;
+  comp=_sort_stat_wrap(comp);
+  #Endif;
+  nth_words(arr, from, to, k, comp);
+  qsort_words(arr, from, k-1, comp);
+];
+
+[ top_words arr from to n comp;
+  if(comp>0 && comp<_SORT_MODES) {
+    _sort_flip(arr, from, to, comp);
+    top_words(arr, from, to, n);
+    _sort_flip(arr, from, to, comp);
+    return;
+  }
+  #Ifdef SORTING_STATS;
+  comp=_sort_stat_wrap(comp);
+  #Endif;
+  nth_words(arr, from, to, to-n+1, comp);
+  qsort_words(arr, to-n+2, to, comp);
+];
+
+#Endif; ! Not NOWORDSORT;
+
+#Endif; ! Not NODIRECTSORT;
+
+#Endif; ! Not NOSELECTION
 
 !!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!
-! Direct ShellSort routines.
+! Key-extraction sort routines.
+!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!
+
+#Ifndef NOKEYSORT;
+#Ifndef NOINDEXSORT;
+#Ifndef NOWORDSORT;
+
+! Rearranges arr-->from..arr-->to (and arr2-->from..arr2-->to, if arr2 is
+! given) so that position i gets the element that was at position index-->i,
+! by following each cycle of the permutation once. This moves every element
+! at most once, and needs no scratch space. The index is left holding the
+! numbers from..to.
+[ _sort_permute arr index from to arr2   i j k v v2;
+  for(i=from: i<=to: i++) {
+    if(index-->i==i)
+      continue;
+    v=arr-->i;
+    if(arr2)
+      v2=arr2-->i;
+    j=i;
+    #Ifdef SORTING_STATS;
+    sort_stat_moves++;
+    #Endif;
+    for(k=index-->j: k~=i: k=index-->j) {
+      #Ifdef SORTING_STATS;
+      sort_stat_moves++;
+      #Endif;
+      arr-->j=arr-->k;
+      if(arr2)
+        arr2-->j=arr2-->k;
+      index-->j=j;
+      j=k;
+    }
+    arr-->j=v;
+    if(arr2)
+      arr2-->j=v2;
+    index-->j=j;
+  }
+];
+
+[ keysort_words_idx arr index keys from to keyfn   i;
+  for(i=from: i<=to: i++)
+    keys-->i=keyfn(arr-->i);
+  qsort_words_idx(keys, index, from, to);
+];
+
+#Ifndef NODIRECTSORT;
+
+[ keysort_words arr index keys from to keyfn;
+  keysort_words_idx(arr, index, keys, from, to, keyfn);
+  _sort_permute(arr, index, from, to, keys);
+];
+
+#Ifndef NOOBJECTSORT;
+
+Default SORTOBJECTSMAX 64;
+
+Array _sort_objs --> SORTOBJECTSMAX;
+Array _sort_okeys --> SORTOBJECTSMAX;
+Array _sort_oidx --> SORTOBJECTSMAX;
+Global _sort_oprop;
+
+[ _sort_reverse arr from to   v;
+  #Ifdef SORTING_STATS;
+  if(to>from)
+    sort_stat_moves=sort_stat_moves+(to-from+1)/2*2;
+  #Endif;
+  for(: from<to: from++, to--) {
+    v=arr-->from;
+    arr-->from=arr-->to;
+    arr-->to=v;
+  }
+];
+
+! Used instead of key extraction when there is no room for the keys.
+[ _sort_okey o;
+  if(o provides _sort_oprop)
+    return o._sort_oprop;
+  return 0;
+];
+
+[ _sort_ocomp a b;
+  return _sort_okey(a) > _sort_okey(b);
+];
+
+[ sort_objects_by_prop arr from to prop desc   i n o keys idx;
+  n=to-from+1;
+  if(n<2)
+    return;
+  keys=_sort_okeys;
+  idx=_sort_oidx;
+  if(n>SORTOBJECTSMAX) {
+    #Ifdef TARGET_GLULX;
+    keys=_sort_malloc(n*WORDSIZE*2);
+    idx=keys+n*WORDSIZE;
+    #Ifnot;
+    keys=0;
+    #Endif;
+    if(keys==0) {
+      _sort_oprop=prop;
+      qsort_words(arr, from, to, _sort_ocomp);
+      if(desc)
+        _sort_reverse(arr, from, to);
+      return;
+    }
+  }
+  arr=arr+from*WORDSIZE;
+  for(i=0: i<n: i++) {
+    o=arr-->i;
+    if(o provides prop)
+      keys-->i=o.prop;
+    else
+      keys-->i=0;
+  }
+  qsort_words_idx(keys, idx, 0, n-1);
+  if(desc)
+    _sort_reverse(idx, 0, n-1);
+  _sort_permute(arr, idx, 0, n-1);
+  #Ifdef TARGET_GLULX;
+  if(keys~=_sort_okeys)
+    @mfree keys;
+  #Endif;
+];
+
+! Sorts the children of par by property prop, or with comp if it is set.
+[ _sort_children par prop desc comp   n o objs;
+  n=children(par);
+  if(n<2)
+    return;
+  objs=_sort_objs;
+  if(n>SORTOBJECTSMAX) {
+    #Ifdef TARGET_GLULX;
+    objs=_sort_malloc(n*WORDSIZE);
+    #Ifnot;
+    objs=0;
+    #Endif;
+    if(objs==0) {
+      print "[** Programming error: sort_children: ", (name) par,
+        " has more than SORTOBJECTSMAX children **]^";
+      return;
+    }
+  }
+  for(o=child(par), n=0: o: o=sibling(o))
+    objs-->(n++)=o;
+  if(comp)
+    qsort_words(objs, 0, n-1, comp);
+  else
+    sort_objects_by_prop(objs, 0, n-1, prop, desc);
+  ! Taking the first child off is O(1), and so is putting an object back
+  ! in as the first child, so the objects go back last one first.
+  for(o=child(par): o: o=child(par))
+    remove o;
+  for(n--: n>=0: n--)
+    move objs-->n to par;
+  #Ifdef TARGET_GLULX;
+  if(objs~=_sort_objs)
+    @mfree objs;
+  #Endif;
+];
+
+[ sort_children par prop desc;
+  _sort_children(par, prop, desc, 0);
+];
+
+[ sort_children_by par comp;
+  _sort_children(par, 0, false, comp);
+];
+
+#Endif; ! Not NOOBJECTSORT;
+
+#Endif; ! Not NODIRECTSORT;
+
+#Endif; ! Not NOWORDSORT;
+#Endif; ! Not NOINDEXSORT;
+#Endif; ! Not NOKEYSORT
+
+!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!
+! Record and parallel array sort routines.
 !!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!
 
+#Ifndef NOINDEXSORT;
+#Ifndef NOWORDSORT;
 #Ifndef NODIRECTSORT;
 
+#Ifndef NORECORDSORT;
+
+Default SORTRECORDSMAX 64;
+Default SORTRECORDSIZE 16;
+
+Array _sort_rkeys --> SORTRECORDSMAX;
+Array _sort_ridx --> SORTRECORDSMAX;
+Array _sort_rbuf -> SORTRECORDSIZE;
+
+#Ifdef TARGET_GLULX;
+
+[ _sort_rcopy src dst len;
+  @mcopy len src dst;
+];
+
+#Ifnot; ! TARGET_GLULX
+
+[ _sort_rcopy src dst len   i;
+  for(i=0: i<len: i++)
+    dst->i=src->i;
+];
+
+#Endif; ! TARGET_GLULX
+
+! Does what _sort_permute does, for the n records of stride bytes at arr,
+! holding the first record of each cycle in buf.
+[ _sort_permute_records arr stride index n buf   i j k;
+  for(i=0: i<n: i++) {
+    if(index-->i==i)
+      continue;
+    _sort_rcopy(arr+i*stride, buf, stride);
+    j=i;
+    #Ifdef SORTING_STATS;
+    sort_stat_moves++;
+    #Endif;
+    for(k=index-->j: k~=i: k=index-->j) {
+      #Ifdef SORTING_STATS;
+      sort_stat_moves++;
+      #Endif;
+      _sort_rcopy(arr+k*stride, arr+j*stride, stride);
+      index-->j=j;
+      j=k;
+    }
+    _sort_rcopy(buf, arr+j*stride, stride);
+    index-->j=j;
+  }
+];
+
+[ _sort_records arr stride key_offset from to comp bytes   i n p keys idx buf;
+  n=to-from+1;
+  if(n<2)
+    return;
+  keys=_sort_rkeys;
+  idx=_sort_ridx;
+  buf=_sort_rbuf;
+  if(n>SORTRECORDSMAX || stride>SORTRECORDSIZE) {
+    #Ifdef TARGET_GLULX;
+    keys=_sort_malloc(n*WORDSIZE*2+stride);
+    idx=keys+n*WORDSIZE;
+    buf=idx+n*WORDSIZE;
+    #Ifnot;
+    keys=0;
+    #Endif;
+    if(keys==0) {
+      print "[** Programming error: sort_records: more than SORTRECORDSMAX
+        records, or records longer than SORTRECORDSIZE bytes **]^";
+      return;
+    }
+  }
+  arr=arr+from*stride;
+  for(i=0, p=arr+key_offset: i<n: i++, p=p+stride)
+    if(bytes)
+      keys-->i=p->0;
+    else
+      keys-->i=p-->0;
+  qsort_words_idx(keys, idx, 0, n-1, comp);
+  _sort_permute_records(arr, stride, idx, n, buf);
+  #Ifdef TARGET_GLULX;
+  if(keys~=_sort_rkeys)
+    @mfree keys;
+  #Endif;
+];
+
+[ sort_records arr stride key_offset from to comp;
+  _sort_records(arr, stride, key_offset, from, to, comp, false);
+];
+
+[ sort_records_bytes arr stride key_offset from to;
+  _sort_records(arr, stride, key_offset, from, to, 0, true);
+];
+
+#Endif; ! Not NORECORDSORT;
+
+#Ifndef NOPARALLELSORT;
+
+Default SORTWITHMAX 64;
+
+Global sort_with_bytes;
+
+Array _sort_widx --> SORTWITHMAX;
+Array _sort_wcol --> 4;
+Array _sort_wbyte -> 4;
+Array _sort_wsave --> 4;
+
+! Moves element k to position j in the keys (column 0) and each payload.
+! If j is -1, element k is saved in _sort_wsave instead, and if k is -1, the
+! saved elements are put at position j.
+[ _sort_wmove j k   c col;
+  for(c=0: c<4: c++) {
+    col=_sort_wcol-->c;
+    if(col==0)
+      continue;
+    if(_sort_wbyte->c) {
+      if(j<0)
+        _sort_wsave-->c=col->k;
+      else if(k<0)
+        col->j=_sort_wsave-->c;
+      else
+        col->j=col->k;
+    } else {
+      if(j<0)
+        _sort_wsave-->c=col-->k;
+      else if(k<0)
+        col-->j=_sort_wsave-->c;
+      else
+        col-->j=col-->k;
+    }
+  }
+];
+
+[ _sort_with keys from to comp p1 p2 p3   i j k n idx;
+  ! sort_with_bytes only holds for one call, so that a caller who forgets
+  ! to clear it can't make the next call write words into byte arrays.
+  _sort_wbyte->1=sort_with_bytes & 1;
+  _sort_wbyte->2=sort_with_bytes & 2;
+  _sort_wbyte->3=sort_with_bytes & 4;
+  sort_with_bytes=0;
+  n=to-from+1;
+  if(n<2)
+    return;
+  idx=_sort_widx;
+  if(n>SORTWITHMAX) {
+    #Ifdef TARGET_GLULX;
+    idx=_sort_malloc(n*WORDSIZE);
+    #Ifnot;
+    idx=0;
+    #Endif;
+    if(idx==0) {
+      print "[** Programming error: sort_words_with: more than SORTWITHMAX
+        elements **]^";
+      return;
+    }
+  }
+  _sort_wcol-->1=p1;
+  _sort_wcol-->2=p2;
+  _sort_wcol-->3=p3;
+  for(i=0: i<4: i++)
+    if(_sort_wcol-->i) {
+      if(_sort_wbyte->i)
+        _sort_wcol-->i=_sort_wcol-->i+from;
+      else
+        _sort_wcol-->i=_sort_wcol-->i+from*WORDSIZE;
+    }
+  #Ifndef NOBYTESORT;
+  if(_sort_wbyte->0)
+    qsort_bytes_idx(keys+from, idx, 0, n-1);
+  #Endif;
+  if(~~(_sort_wbyte->0))
+    qsort_words_idx(keys+from*WORDSIZE, idx, 0, n-1, comp);
+  ! idx-->j is now the element that belongs at j. Follow each cycle,
+  ! saving its first element and shifting the others back along it.
+  for(i=0: i<n: i++) {
+    if(idx-->i==i)
+      continue;
+    _sort_wmove(-1, i);
+    j=i;
+    #Ifdef SORTING_STATS;
+    sort_stat_moves++;
+    #Endif;
+    for(k=idx-->j: k~=i: k=idx-->j) {
+      #Ifdef SORTING_STATS;
+      sort_stat_moves++;
+      #Endif;
+      _sort_wmove(j, k);
+      idx-->j=j;
+      j=k;
+    }
+    _sort_wmove(j, -1);
+    idx-->j=j;
+  }
+  #Ifdef TARGET_GLULX;
+  if(idx~=_sort_widx)
+    @mfree idx;
+  #Endif;
+];
+
+[ sort_words_with keys from to comp p1 p2 p3;
+  _sort_wcol-->0=keys;
+  _sort_wbyte->0=false;
+  _sort_with(keys, from, to, comp, p1, p2, p3);
+];
+
 #Ifndef NOBYTESORT;
 
-[ shsort_bytes arr from to   i j v h k len;
+[ sort_bytes_with keys from to p1 p2 p3;
+  _sort_wcol-->0=keys;
+  _sort_wbyte->0=true;
+  _sort_with(keys, from, to, 0, p1, p2, p3);
+];
+
+#Endif; ! Not NOBYTESORT;
+
+#Endif; ! Not NOPARALLELSORT;
+
+#Endif; ! Not NODIRECTSORT;
+#Endif; ! Not NOWORDSORT;
+#Endif; ! Not NOINDEXSORT;
+
+#Endif; ! Not NOQUICKSORT
+
+
+
+
+#Ifndef NOSHELLSORT;
+
+Default SHELLSORTCONST 3;
+
+Global sort_shell_const = SHELLSORTCONST;
+Global sort_shell_gaps;
+
+! Gap sequences for ShellSort, as tables in ascending order: Marcin Ciura's
+! experimentally found gaps (extended by a factor of 2.25 after 701), and
+! Naoyuki Tokuda's ceil((9*(9/4)^k-4)/5).
+#Ifdef TARGET_GLULX;
+Array sort_gaps_ciura table 1 4 10 23 57 132 301 701 1577 3548 7983 17961
+  40412 90927 204585 460316 1035711 2330349 5243285;
+Array sort_gaps_tokuda table 1 4 9 20 46 103 233 525 1182 2660 5985 13467
+  30301 68178 153401 345152 776591 1747331 3931496 8845866;
+#Ifnot;
+Array sort_gaps_ciura table 1 4 10 23 57 132 301 701 1577 3548 7983 17961;
+Array sort_gaps_tokuda table 1 4 9 20 46 103 233 525 1182 2660 5985 13467
+  30301;
+#Endif;
+
+! The ShellSort loops start with h=_sh_start(to-from+1), and take the next
+! gap with h=_sh_next(h) until it is 0. With a gap table, _sh_next
+! returns the largest gap in it that is less than h. Whatever the settings,
+! the gap before 0 is always 1, so a stepsort that is under way when
+! sort_shell_const or sort_shell_gaps changes still ends up sorted.
+[ _sh_start len   h;
+  if(sort_shell_gaps)
+    return len;
   h=1;
-  len=to-from+1;
   while(h < len)
-    h=SHELLSORTCONST*h+1;
-  while((h=(h-1)/SHELLSORTCONST)>=1)
-    for(k=0: k<h: k++)
-      for(i=k+h+from: i<=to: i=i+h) {
-        j=i;
-        v=arr->i;
-        while((j=j-h) >= from && arr->j > v)
-            arr->(j+h)=arr->j;
-        arr->(j+h)=v;
-      }
+    h=sort_shell_const*h+1;
+  return h;
 ];
 
-#Endif; ! Not NOBYTESORT;
+[ _sh_next h   i;
+  if(h<=1)
+    return 0;
+  if(sort_shell_gaps==0) {
+    h=(h-1)/sort_shell_const;
+    if(h<1)
+      return 1;
+    return h;
+  }
+  for(i=sort_shell_gaps-->0: i>=1: i--)
+    if(sort_shell_gaps-->i < h)
+      return sort_shell_gaps-->i;
+  return 1;
+];
 
-#Ifndef NOWORDSORT;
+!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!
+! Index-based ShellSort routines.
+!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!
 
-[ _ssg_sub arr from to comp h   i j v k;
-  while((h=(h-1)/SHELLSORTCONST)>=1)
+#Ifndef NOINDEXSORT;
+
+#Ifndef NOBYTESORT;
+
+[ shsort_bytes_idx arr index from to   i vi j v h k len;
+  #Ifndef NOCOUNTSORT;
+  if(to-from>=COUNTSORTLIMIT)
+    return countsort_bytes_idx(arr, index, from, to);
+  #Endif;
+  len=to-from+1;
+  h=_sh_start(len);
+  for(i=from:i<=to:i++)
+    index-->i=i;
+  while((h=_sh_next(h))>=1)
     for(k=0: k<h: k++)
       for(i=k+h+from: i<=to: i=i+h) {
         j=i;
-        v=arr-->i;
-        while(((j=j-h) >= from) && comp(arr-->j, v))
-            arr-->(j+h)=arr-->j;
-        arr-->(j+h)=v;
+        vi=index-->i;
+        v=arr->vi;
+        while((j=j-h) >= from && arr->(index-->j) > v)
+            index-->(j+h)=index-->j;
+        #Ifdef SORTING_STATS;
+        sort_stat_moves=sort_stat_moves+(i-j)/h-1;
+        sort_stat_compares=sort_stat_compares+(i-j)/h-1+(j>=from);
+        #Endif;
+        index-->(j+h)=vi;
       }
 ];
 
-[ shsort_words arr from to comp   i j v h k len;
-  h=1;
+[ shsort_bytes_bidx arr index from to   i vi j v h k len;
+  if(to>255) {
+    print "[** Programming error: shsort_bytes_bidx: to is more than 255 **]^";
+    return;
+  }
   len=to-from+1;
-  while(h < len)
-    h=SHELLSORTCONST*h+1;
-  if(comp)
-    return _ssg_sub(arr, from, to, comp, h);
-  while((h=(h-1)/SHELLSORTCONST)>=1)
+  h=_sh_start(len);
+  for(i=from:i<=to:i++)
+    index->i=i;
+  while((h=_sh_next(h))>=1)
     for(k=0: k<h: k++)
       for(i=k+h+from: i<=to: i=i+h) {
         j=i;
-        v=arr-->i;
-        while((j=j-h) >= from && arr-->j > v)
-            arr-->(j+h)=arr-->j;
-        arr-->(j+h)=v;
+        vi=index->i;
+        v=arr->vi;
+        while((j=j-h) >= from && arr->(index->j) > v)
+            index->(j+h)=index->j;
+        #Ifdef SORTING_STATS;
+        sort_stat_moves=sort_stat_moves+(i-j)/h-1;
+        sort_stat_compares=sort_stat_compares+(i-j)/h-1+(j>=from);
+        #Endif;
+        index->(j+h)=vi;
       }
 ];
 
-#Endif; ! Not NOWORDSORT;
+#Endif; ! Not NOBYTESORT;
+
+#Ifndef NOWORDSORT;
+
+[ _ssgi_sub arr index from to comp h   i vi j v k;
+  while((h=_sh_next(h))>=1)
+    for(k=0: k<h: k++)
+      for(i=k+h+from: i<=to: i=i+h) {
+        j=i;
+        vi=index-->i;
+        v=arr-->vi;
+        while((j=j-h) >= from && comp(arr-->(index-->j), v))
+            index-->(j+h)=index-->j;
+        #Ifdef SORTING_STATS;
+        sort_stat_moves=sort_stat_moves+(i-j)/h-1;
+        #Endif;
+        index-->(j+h)=vi;
+      }
+];
+
+! Mode-aware ShellSort core. See _sort_flip.
+[ _ssmi_sub arr index from to u d h   i vi j v k w;
+  while((h=_sh_next(h))>=1)
+    for(k=0: k<h: k++)
+      for(i=k+h+from: i<=to: i=i+h) {
+        vi=index-->i;
+        v=arr-->vi+u;
+        if(d)
+          v=~v;
+        for(j=i-h: j>=from: j=j-h) {
+          w=arr-->(index-->j)+u;
+          if(d)
+            w=~w;
+          if(w<=v)
+            break;
+          index-->(j+h)=index-->j;
+        }
+        index-->(j+h)=vi;
+      }
+];
+
+[ shsort_words_idx arr index from to comp   h i vi j v k len;
+  #Ifdef SORTING_STATS;
+  comp=_sort_stat_wrap(comp);
+  #Ifnot;
+  if(comp>0 && comp<_SORT_MODES) {
+    for(i=from:i<=to:i++)
+      index-->i=i;
+    return _ssmi_sub(arr, index, from, to,
+      (comp & SORT_UNSIGNED)*_SORT_HIGHBIT, comp & SORT_DESCENDING,
+      _sh_start(to-from+1));
+  }
+  #Endif;
+  for(i=from:i<=to:i++)
+    index-->i=i;
+  len=to-from+1;
+  h=_sh_start(len);
+  if(comp)
+    return _ssgi_sub(arr, index, from, to, comp, h);
+  while((h=_sh_next(h))>=1)
+    for(k=0: k<h: k++)
+      for(i=k+h+from: i<=to: i=i+h) {
+        j=i;
+        vi=index-->i;
+        v=arr-->vi;
+        while((j=j-h) >= from && arr-->(index-->j) > v)
+            index-->(j+h)=index-->j;
+        index-->(j+h)=vi;
+      }
+];
+
+[ shsort_words_bidx arr index from to comp   h i vi j v k len w u d;
+  if(to>255) {
+    print "[** Programming error: shsort_words_bidx: to is more than 255 **]^";
+    return;
+  }
+  #Ifdef SORTING_STATS;
+  comp=_sort_stat_wrap(comp);
+  #Ifnot;
+  if(comp>0 && comp<_SORT_MODES) {
+    if(comp & SORT_UNSIGNED)
+      u=_SORT_HIGHBIT;
+    d=comp & SORT_DESCENDING;
+    comp=0;
+  }
+  #Endif;
+  for(i=from:i<=to:i++)
+    index->i=i;
+  len=to-from+1;
+  h=_sh_start(len);
+  while((h=_sh_next(h))>=1)
+    for(k=0: k<h: k++)
+      for(i=k+h+from: i<=to: i=i+h) {
+        j=i;
+        vi=index->i;
+        v=arr-->vi;
+        if(comp)
+          while((j=j-h) >= from && comp(arr-->(index->j), v))
+            index->(j+h)=index->j;
+        else {
+          v=v+u;
+          if(d)
+            v=~v;
+          while((j=j-h) >= from) {
+            w=arr-->(index->j)+u;
+            if(d)
+              w=~w;
+            if(w<=v)
+              break;
+            index->(j+h)=index->j;
+          }
+        }
+        #Ifdef SORTING_STATS;
+        sort_stat_moves=sort_stat_moves+(i-j)/h-1;
+        #Endif;
+        index->(j+h)=vi;
+      }
+];
+
+#Endif; ! Not NOWORDSORT;
+
+#Endif; ! Not NOINDEXSORT;
+
+
+!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!
+! Direct ShellSort routines.
+!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!
+
+#Ifndef NODIRECTSORT;
+
+#Ifndef NOBYTESORT;
+
+[ shsort_bytes arr from to   i j v h k len;
+  #Ifndef NOCOUNTSORT;
+  if(to-from>=COUNTSORTLIMIT)
+    return countsort_bytes(arr, from, to);
+  #Endif;
+  len=to-from+1;
+  h=_sh_start(len);
+  while((h=_sh_next(h))>=1)
+    for(k=0: k<h: k++)
+      for(i=k+h+from: i<=to: i=i+h) {
+        j=i;
+        v=arr->i;
+        while((j=j-h) >= from && arr->j > v)
+            arr->(j+h)=arr->j;
+        #Ifdef SORTING_STATS;
+        sort_stat_moves=sort_stat_moves+(i-j)/h-1;
+        sort_stat_compares=sort_stat_compares+(i-j)/h-1+(j>=from);
+        #Endif;
+        arr->(j+h)=v;
+      }
+];
+
+#Endif; ! Not NOBYTESORT;
+
+#Ifndef NOWORDSORT;
+
+[ _ssg_sub arr from to comp h   i j v k;
+  while((h=_sh_next(h))>=1)
+    for(k=0: k<h: k++)
+      for(i=k+h+from: i<=to: i=i+h) {
+        j=i;
+        v=arr-->i;
+        while(((j=j-h) >= from) && comp(arr-->j, v))
+            arr-->(j+h)=arr-->j;
+        #Ifdef SORTING_STATS;
+        sort_stat_moves=sort_stat_moves+(i-j)/h-1;
+        #Endif;
+        arr-->(j+h)=v;
+      }
+];
+
+[ shsort_words arr from to comp   i j v h k len;
+  if(comp>0 && comp<_SORT_MODES) {
+    _sort_flip(arr, from, to, comp);
+    shsort_words(arr, from, to);
+    _sort_flip(arr, from, to, comp);
+    return;
+  }
+  #Ifdef SORTING_STATS;
+  comp=_sort_stat_wrap(comp);
+  #Endif;
+  len=to-from+1;
+  h=_sh_start(len);
+  if(comp)
+    return _ssg_sub(arr, from, to, comp, h);
+  while((h=_sh_next(h))>=1)
+    for(k=0: k<h: k++)
+      for(i=k+h+from: i<=to: i=i+h) {
+        j=i;
+        v=arr-->i;
+        while((j=j-h) >= from && arr-->j > v)
+            arr-->(j+h)=arr-->j;
+        arr-->(j+h)=v;
+      }
+];
+
+!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!
+! Step-by-step ShellSort routines.
+!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!
+
+! The context holds the array, from, to and the comparison function, the
+! current gap h (0 when the sort is done), the element i that is being
+! inserted among the elements h apart before it, and the position j it has
+! been swapped down to so far.
+
+Constant STEPSORT_SIZE 7;
+
+[ stepsort_start ctx arr from to comp   h;
+  h=_sh_next(_sh_start(to-from+1));
+  ctx-->0=arr;
+  ctx-->1=from;
+  ctx-->2=to;
+  ctx-->3=comp;
+  ctx-->4=h;
+  ctx-->5=from+h;
+  ctx-->6=from+h;
+];
+
+[ stepsort_step ctx n   arr from comp h i j a b w;
+  arr=ctx-->0;
+  from=ctx-->1;
+  comp=ctx-->3;
+  h=ctx-->4;
+  i=ctx-->5;
+  j=ctx-->6;
+  while(h>0) {
+    if(i>ctx-->2) {
+      h=_sh_next(h);
+      i=from+h;
+      j=i;
+      continue;
+    }
+    w=false;
+    if(j-h>=from) {
+      if(n<=0)
+        break;
+      n--;
+      a=arr-->(j-h);
+      b=arr-->j;
+      #Ifdef SORTING_STATS;
+      sort_stat_compares++;
+      #Endif;
+      if(comp==0)
+        w=a>b;
+      else if(comp>0 && comp<_SORT_MODES) {
+        if(comp & SORT_UNSIGNED) {
+          a=a+_SORT_HIGHBIT;
+          b=b+_SORT_HIGHBIT;
+        }
+        if(comp & SORT_DESCENDING)
+          w=a<b;
+        else
+          w=a>b;
+      } else {
+        #Ifdef SORTING_STATS;
+        sort_stat_calls++;
+        #Endif;
+        w=comp(a, b);
+      }
+    }
+    if(w) {
+      #Ifdef SORTING_STATS;
+      sort_stat_moves=sort_stat_moves+2;
+      #Endif;
+      b=arr-->j;
+      arr-->j=arr-->(j-h);
+      j=j-h;
+      arr-->j=b;
+    } else {
+      i++;
+      j=i;
+    }
+  }
+  ctx-->4=h;
+  ctx-->5=i;
+  ctx-->6=j;
+  return h==0;
+];
+
+[ stepsort_done ctx;
+  return ctx-->4==0;
+];
+
+#Endif; ! Not NOWORDSORT;
 
 #Endif; ! Not NODIRECTSORT;
 
 #Endif; ! Not NOSHELLSORT
 
+!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!
+! Calibration.
+!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!
+
+#Ifndef NOWORDSORT;
+#Ifndef NODIRECTSORT;
+
+#Ifdef TARGET_GLULX;
+
+Default SORTCALIBRATESIZE 1000;
+
+Array _sort_tv --> 3;
+Array _sort_qs_limits --> 4 6 8 10 12 16 20;
+
+! Returns the number of microseconds it takes to sort the same n
+! pseudo-random words three times, with QuickSort if qs is set, or with
+! ShellSort if it isn't.
+[ _sort_time arr n qs   i k seed sec usec t res tv;
+  tv=_sort_tv;
+  for(k=0: k<3: k++) {
+    seed=1;
+    for(i=0: i<n: i++) {
+      seed=(seed*25173+13849) & $FFFF;
+      arr-->i=seed;
+    }
+    @copy tv sp;
+    @glk $0160 1 res;
+    sec=_sort_tv-->1;
+    usec=_sort_tv-->2;
+    #Ifndef NOQUICKSORT;
+    if(qs)
+      qsort_words(arr, 0, n-1);
+    #Endif;
+    #Ifndef NOSHELLSORT;
+    if(~~qs)
+      shsort_words(arr, 0, n-1);
+    #Endif;
+    @copy tv sp;
+    @glk $0160 1 res;
+    t=t+(_sort_tv-->1-sec)*1000000+_sort_tv-->2-usec;
+  }
+  return t;
+];
+
+[ sort_calibrate   arr n i t best win res;
+  @copy 0 sp;
+  @copy 20 sp;
+  @glk $0004 2 res;
+  if(res==0)
+    rfalse;
+  n=SORTCALIBRATESIZE;
+  arr=_sort_malloc(n*WORDSIZE);
+  if(arr==0)
+    rfalse;
+  #Ifndef NOQUICKSORT;
+  best=-1;
+  for(i=0: i<7: i++) {
+    sort_qs_limit=_sort_qs_limits-->i;
+    t=_sort_time(arr, n, true);
+    if(best<0 || t<best) {
+      best=t;
+      win=sort_qs_limit;
+    }
+  }
+  sort_qs_limit=win;
+  #Endif;
+  #Ifndef NOSHELLSORT;
+  ! Candidates 0 to 2 are the sequences h=c*h+1 for c from 2 to 4, and 3
+  ! and 4 are the Ciura and Tokuda gap tables.
+  best=-1;
+  for(i=0: i<5: i++) {
+    sort_shell_gaps=0;
+    if(i<3)
+      sort_shell_const=i+2;
+    else if(i==3)
+      sort_shell_gaps=sort_gaps_ciura;
+    else
+      sort_shell_gaps=sort_gaps_tokuda;
+    t=_sort_time(arr, n, false);
+    if(best<0 || t<best) {
+      best=t;
+      win=i;
+    }
+  }
+  sort_shell_gaps=0;
+  sort_shell_const=SHELLSORTCONST;
+  if(win<3)
+    sort_shell_const=win+2;
+  else if(win==3)
+    sort_shell_gaps=sort_gaps_ciura;
+  else
+    sort_shell_gaps=sort_gaps_tokuda;
+  #Endif;
+  @mfree arr;
+  rtrue;
+];
+
+#Ifnot; ! TARGET_GLULX
+
+[ sort_calibrate;
+  rfalse;
+];
+
+#Endif; ! TARGET_GLULX
+
+#Endif; ! Not NODIRECTSORT;
+#Endif; ! Not NOWORDSORT;
+
+!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!
+! Adaptive sort routines.
+!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!
+
+#Ifndef NOADAPTIVESORT;
+#Ifndef NOQUICKSORT;
+#Ifndef NODIRECTSORT;
+
+Constant SORT_PATH_SORTED 1;
+Constant SORT_PATH_REVERSED 2;
+Constant SORT_PATH_INSERTION 3;
+Constant SORT_PATH_COUNTING 4;
+Constant SORT_PATH_RADIX 5;
+Constant SORT_PATH_SHELL 6;
+Constant SORT_PATH_QUICK 7;
+
+Default SORTADAPTIVESMALL 16;
+Default SORTRADIXMIN 256;
+
+Constant _SORT_SAMPLES 16;
+Array _sort_sample --> _SORT_SAMPLES;
+
+[ _sort_ad_get arr i bytes;
+  if(bytes)
+    return arr->i;
+  return arr-->i;
+];
+
+! Returns true if a should end up after b, for a comparison function, a
+! mode or 0.
+[ _sort_ad_after a b comp   t;
+  #Ifdef SORTING_STATS;
+  sort_stat_compares++;
+  #Endif;
+  if(comp==0)
+    return a>b;
+  #Ifndef NOWORDSORT;
+  if(comp>0 && comp<_SORT_MODES) {
+    if(comp & SORT_DESCENDING) {
+      t=a;
+      a=b;
+      b=t;
+    }
+    if(comp & SORT_UNSIGNED)
+      return a+_SORT_HIGHBIT > b+_SORT_HIGHBIT;
+    return a>b;
+  }
+  #Endif;
+  #Ifdef SORTING_STATS;
+  sort_stat_calls++;
+  #Endif;
+  return comp(a, b);
+];
+
+! Compares up to _SORT_SAMPLES pairs of elements half the range apart, and
+! returns how many of them are out of order, scaled to _SORT_SAMPLES pairs.
+[ _sort_ad_inversions arr from n comp bytes   i j h m step inv;
+  h=n/2;
+  m=_SORT_SAMPLES;
+  if(h<m)
+    m=h;
+  step=h/m;
+  for(i=0: i<m: i++) {
+    j=from+i*step;
+    if(_sort_ad_after(_sort_ad_get(arr, j, bytes),
+        _sort_ad_get(arr, j+h, bytes), comp))
+      inv++;
+  }
+  return inv*_SORT_SAMPLES/m;
+];
+
+! Returns the number of different values among up to _SORT_SAMPLES
+! elements spread evenly over the range, scaled to _SORT_SAMPLES elements.
+[ _sort_ad_distinct arr from n bytes   i j v m step dist;
+  m=_SORT_SAMPLES;
+  if(n<m)
+    m=n;
+  step=n/m;
+  for(i=0: i<m: i++) {
+    v=_sort_ad_get(arr, from+i*step, bytes);
+    for(j=0: j<dist && _sort_sample-->j~=v: j++);
+    if(j==dist)
+      _sort_sample-->(dist++)=v;
+  }
+  return dist*_SORT_SAMPLES/m;
+];
+
+! Picks the way to sort the range. One pass counts the descents (places
+! where an element belongs after the next one), which settles sorted,
+! reversed and small ranges. Then a sample of pairs far apart tells partly
+! sorted data from data with elements far out of place, and a sample of
+! values tells if there are only a few different values. A large range
+! never goes to InsertionSort, however few descents it has: two sorted
+! halves have only one, but can take n*n/4 moves to merge that way.
+[ _sort_choose arr from to comp bytes   i n a b desc inv dist;
+  n=to-from+1;
+  a=_sort_ad_get(arr, from, bytes);
+  for(i=from+1: i<=to: i++) {
+    b=_sort_ad_get(arr, i, bytes);
+    if(_sort_ad_after(a, b, comp))
+      desc++;
+    a=b;
+  }
+  if(desc==0)
+    return SORT_PATH_SORTED;
+  if(desc==n-1)
+    return SORT_PATH_REVERSED;
+  if(n<=SORTADAPTIVESMALL)
+    return SORT_PATH_INSERTION;
+  inv=_sort_ad_inversions(arr, from, n, comp, bytes);
+  dist=_sort_ad_distinct(arr, from, n, bytes);
+  if(bytes) {
+    #Ifndef NOCOUNTSORT;
+    #Ifndef NOBYTESORT;
+    if(n>=COUNTSORTLIMIT || dist*4<=_SORT_SAMPLES)
+      return SORT_PATH_COUNTING;
+    #Endif;
+    #Endif;
+  } else {
+    #Ifdef TARGET_GLULX;
+    #Ifndef NORADIXSORT;
+    #Ifndef NOWORDSORT;
+    ! RadixSort takes its scratch space from the heap.
+    @gestalt 7 0 a;
+    if(a && (comp==0 || (comp>0 && comp<_SORT_MODES)) && n>=SORTRADIXMIN)
+      return SORT_PATH_RADIX;
+    #Endif;
+    #Endif;
+    #Endif;
+  }
+  #Ifndef NOSHELLSORT;
+  if(inv*8<=_SORT_SAMPLES || desc<=n/4)
+    return SORT_PATH_SHELL;
+  #Iftrue QUICKSORT3WAY==0;
+  if(dist*4<=_SORT_SAMPLES)
+    return SORT_PATH_SHELL;
+  #Endif;
+  #Endif;
+  return SORT_PATH_QUICK;
+];
+
+#Ifndef NOBYTESORT;
+
+[ sort_bytes arr from to   path i j v;
+  if(to<=from)
+    return;
+  path=_sort_choose(arr, from, to, 0, true);
+  #Ifdef SORTING_STATS;
+  sort_stat_path=path;
+  #Endif;
+  if(path==SORT_PATH_REVERSED) {
+    for(i=from, j=to: i<j: i++, j--) {
+      v=arr->i;
+      arr->i=arr->j;
+      arr->j=v;
+    }
+    #Ifdef SORTING_STATS;
+    sort_stat_moves=sort_stat_moves+(to-from+1)/2*2;
+    #Endif;
+  } else if(path==SORT_PATH_INSERTION)
+    inssort_bytes(arr, from, to);
+  #Ifndef NOCOUNTSORT;
+  else if(path==SORT_PATH_COUNTING)
+    countsort_bytes(arr, from, to);
+  #Endif;
+  #Ifndef NOSHELLSORT;
+  else if(path==SORT_PATH_SHELL)
+    shsort_bytes(arr, from, to);
+  #Endif;
+  else if(path==SORT_PATH_QUICK)
+    qsort_bytes(arr, from, to);
+];
+
+#Endif; ! Not NOBYTESORT;
+
+#Ifndef NOWORDSORT;
+
+[ sort_words arr from to comp   path i j v;
+  if(to<=from)
+    return;
+  path=_sort_choose(arr, from, to, comp, false);
+  #Ifdef SORTING_STATS;
+  sort_stat_path=path;
+  #Endif;
+  if(path==SORT_PATH_REVERSED) {
+    for(i=from, j=to: i<j: i++, j--) {
+      v=arr-->i;
+      arr-->i=arr-->j;
+      arr-->j=v;
+    }
+    #Ifdef SORTING_STATS;
+    sort_stat_moves=sort_stat_moves+(to-from+1)/2*2;
+    #Endif;
+  } else if(path==SORT_PATH_INSERTION)
+    inssort_words(arr, from, to, comp);
+  #Ifdef TARGET_GLULX;
+  #Ifndef NORADIXSORT;
+  else if(path==SORT_PATH_RADIX)
+    radix_words(arr, 0, from, to, comp);
+  #Endif;
+  #Endif;
+  #Ifndef NOSHELLSORT;
+  else if(path==SORT_PATH_SHELL)
+    shsort_words(arr, from, to, comp);
+  #Endif;
+  else if(path==SORT_PATH_QUICK)
+    qsort_words(arr, from, to, comp);
+];
+
+#Ifndef NOINDEXSORT;
+
+[ sort_words_idx arr index from to comp   path i;
+  for(i=from: i<=to: i++)
+    index-->i=i;
+  if(to<=from)
+    return;
+  path=_sort_choose(arr, from, to, comp, false);
+  #Ifdef SORTING_STATS;
+  sort_stat_path=path;
+  #Endif;
+  if(path==SORT_PATH_REVERSED) {
+    for(i=from: i<=to: i++)
+      index-->i=from+to-i;
+    #Ifdef SORTING_STATS;
+    sort_stat_moves=sort_stat_moves+to-from+1;
+    #Endif;
+  } else if(path==SORT_PATH_INSERTION)
+    inssort_words_idx(arr, index, from, to, comp);
+  #Ifdef TARGET_GLULX;
+  #Ifndef NORADIXSORT;
+  else if(path==SORT_PATH_RADIX)
+    radix_words_idx(arr, index, 0, from, to, comp);
+  #Endif;
+  #Endif;
+  #Ifndef NOSHELLSORT;
+  else if(path==SORT_PATH_SHELL)
+    shsort_words_idx(arr, index, from, to, comp);
+  #Endif;
+  else if(path==SORT_PATH_QUICK)
+    qsort_words_idx(arr, index, from, to, comp);
+];
+
+#Endif; ! Not NOINDEXSORT;
+
+#Endif; ! Not NOWORDSORT;
+
+#Endif; ! Not NODIRECTSORT;
+#Endif; ! Not NOQUICKSORT;
+#Endif; ! Not NOADAPTIVESORT;
+
+
+
+
+#Ifndef NOMERGESORT;
+
+Default MERGESORTRUN 8;
+
+!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!
+! Index-based MergeSort routines.
+!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!
+
+! The merge routines merge the sorted runs lo..mid-1 and mid..hi. Only the
+! left run is copied out to the scratch array, and a left element always
+! goes before an equal right element, which is what keeps MergeSort stable.
+
+#Ifndef NOINDEXSORT;
+
+#Ifndef NOBYTESORT;
+
+[ _msbi_merge arr index scratch lo mid hi   i j k n;
+  #Ifdef SORTING_STATS;
+  sort_stat_compares++;
+  #Endif;
+  if(arr->(index-->(mid-1)) <= arr->(index-->mid))
+    return;
+  n=mid-lo;
+  #Ifdef TARGET_GLULX;
+  i=n*WORDSIZE;
+  j=index+lo*WORDSIZE;
+  @mcopy i j scratch;
+  #Ifnot;
+  for(i=0: i<n: i++)
+    scratch-->i=index-->(lo+i);
+  #Endif;
+  for(i=0, j=mid, k=lo: i<n && j<=hi: k++)
+    if(arr->(scratch-->i) > arr->(index-->j))
+      index-->k=index-->(j++);
+    else
+      index-->k=scratch-->(i++);
+  #Ifdef SORTING_STATS;
+  sort_stat_compares=sort_stat_compares+k-lo;
+  sort_stat_moves=sort_stat_moves+n+k-lo+n-i;
+  #Endif;
+  #Ifdef TARGET_GLULX;
+  if(i<n) {
+    n=(n-i)*WORDSIZE;
+    i=scratch+i*WORDSIZE;
+    k=index+k*WORDSIZE;
+    @mcopy n i k;
+  }
+  #Ifnot;
+  for(: i<n: i++, k++)
+    index-->k=scratch-->i;
+  #Endif;
+];
+
+[ msort_bytes_idx arr index scratch from to   i j v vi lo hi w;
+  for(i=from:i<=to:i++)
+    index-->i=i;
+  if(to<=from)
+    return;
+  #Ifdef TARGET_GLULX;
+  if(scratch==0) {
+    scratch=_sort_malloc((to-from+1)*WORDSIZE);
+    if(scratch) {
+      msort_bytes_idx(arr, index, scratch, from, to);
+      @mfree scratch;
+      return;
+    }
+  }
+  #Endif;
+  #Ifndef NOCOUNTSORT;
+  if(scratch==0)
+    return countsort_bytes_idx(arr, index, from, to);
+  #Endif;
+  w=MERGESORTRUN;
+  if(scratch==0)
+    w=to-from+1;
+  for(lo=from: lo<=to: lo=lo+w) {
+    hi=lo+w-1;
+    if(hi>to)
+      hi=to;
+    for(i=lo+1: i<=hi: i++) {
+      vi=index-->i;
+      v=arr->vi;
+      for(j=i: j>lo && arr->(index-->(j-1)) > v: j--)
+        index-->j=index-->(j-1);
+      #Ifdef SORTING_STATS;
+      sort_stat_moves=sort_stat_moves+i-j;
+      sort_stat_compares=sort_stat_compares+i-j+(j>lo);
+      #Endif;
+      index-->j=vi;
+    }
+  }
+  if(scratch)
+    for(w=MERGESORTRUN: w<=to-from: w=w+w)
+      for(lo=from: lo+w<=to: lo=lo+w+w) {
+        hi=lo+w+w-1;
+        if(hi>to)
+          hi=to;
+        _msbi_merge(arr, index, scratch, lo, lo+w, hi);
+      }
+];
+
+#Endif; ! Not NOBYTESORT;
+
+#Ifndef NOWORDSORT;
+
+[ _mswi_merge arr index scratch lo mid hi   i j k n;
+  if(arr-->(index-->(mid-1)) <= arr-->(index-->mid))
+    return;
+  n=mid-lo;
+  #Ifdef TARGET_GLULX;
+  i=n*WORDSIZE;
+  j=index+lo*WORDSIZE;
+  @mcopy i j scratch;
+  #Ifnot;
+  for(i=0: i<n: i++)
+    scratch-->i=index-->(lo+i);
+  #Endif;
+  for(i=0, j=mid, k=lo: i<n && j<=hi: k++)
+    if(arr-->(scratch-->i) > arr-->(index-->j))
+      index-->k=index-->(j++);
+    else
+      index-->k=scratch-->(i++);
+  #Ifdef TARGET_GLULX;
+  if(i<n) {
+    n=(n-i)*WORDSIZE;
+    i=scratch+i*WORDSIZE;
+    k=index+k*WORDSIZE;
+    @mcopy n i k;
+  }
+  #Ifnot;
+  for(: i<n: i++, k++)
+    index-->k=scratch-->i;
+  #Endif;
+];
+
+! Mode-aware merge, which takes the mode whole, like _selmi_sub.
+[ _msmi_merge arr index scratch lo mid hi mode   i j k n u d v w;
+  u=(mode & SORT_UNSIGNED)*_SORT_HIGHBIT;
+  d=mode & SORT_DESCENDING;
+  v=arr-->(index-->(mid-1))+u;
+  w=arr-->(index-->mid)+u;
+  if(d) {
+    v=~v;
+    w=~w;
+  }
+  if(v<=w)
+    return;
+  n=mid-lo;
+  #Ifdef TARGET_GLULX;
+  i=n*WORDSIZE;
+  j=index+lo*WORDSIZE;
+  @mcopy i j scratch;
+  #Ifnot;
+  for(i=0: i<n: i++)
+    scratch-->i=index-->(lo+i);
+  #Endif;
+  for(i=0, j=mid, k=lo: i<n && j<=hi: k++) {
+    v=arr-->(scratch-->i)+u;
+    w=arr-->(index-->j)+u;
+    if(d) {
+      v=~v;
+      w=~w;
+    }
+    if(v>w)
+      index-->k=index-->(j++);
+    else
+      index-->k=scratch-->(i++);
+  }
+  #Ifdef TARGET_GLULX;
+  if(i<n) {
+    n=(n-i)*WORDSIZE;
+    i=scratch+i*WORDSIZE;
+    k=index+k*WORDSIZE;
+    @mcopy n i k;
+  }
+  #Ifnot;
+  for(: i<n: i++, k++)
+    index-->k=scratch-->i;
+  #Endif;
+];
+
+[ _msgi_merge arr index scratch lo mid hi comp   i j k n;
+  if(~~comp(arr-->(index-->(mid-1)), arr-->(index-->mid)))
+    return;
+  n=mid-lo;
+  #Ifdef TARGET_GLULX;
+  i=n*WORDSIZE;
+  j=index+lo*WORDSIZE;
+  @mcopy i j scratch;
+  #Ifnot;
+  for(i=0: i<n: i++)
+    scratch-->i=index-->(lo+i);
+  #Endif;
+  for(i=0, j=mid, k=lo: i<n && j<=hi: k++)
+    if(comp(arr-->(scratch-->i), arr-->(index-->j)))
+      index-->k=index-->(j++);
+    else
+      index-->k=scratch-->(i++);
+  #Ifdef SORTING_STATS;
+  sort_stat_moves=sort_stat_moves+n+k-lo+n-i;
+  #Endif;
+  #Ifdef TARGET_GLULX;
+  if(i<n) {
+    n=(n-i)*WORDSIZE;
+    i=scratch+i*WORDSIZE;
+    k=index+k*WORDSIZE;
+    @mcopy n i k;
+  }
+  #Ifnot;
+  for(: i<n: i++, k++)
+    index-->k=scratch-->i;
+  #Endif;
+];
+
+[ msort_words_idx arr index scratch from to comp   i j v vi lo hi w mode;
+  for(i=from:i<=to:i++)
+    index-->i=i;
+  if(to<=from)
+    return;
+  #Ifdef TARGET_GLULX;
+  if(scratch==0) {
+    scratch=_sort_malloc((to-from+1)*WORDSIZE);
+    if(scratch) {
+      msort_words_idx(arr, index, scratch, from, to, comp);
+      @mfree scratch;
+      return;
+    }
+  }
+  #Endif;
+  if(scratch==0)
+    return ipsort_words_idx(arr, index, from, to, comp);
+  #Ifdef SORTING_STATS;
+  comp=_sort_stat_wrap(comp);
+  #Ifnot;
+  if(comp>0 && comp<_SORT_MODES) {
+    mode=comp;
+    comp=0;
+  }
+  #Endif;
+  w=MERGESORTRUN;
+  for(lo=from: lo<=to: lo=lo+w) {
+    hi=lo+w-1;
+    if(hi>to)
+      hi=to;
+    if(mode) {
+      _ismi_sub(arr, index, lo, hi, (mode & SORT_UNSIGNED)*_SORT_HIGHBIT,
+        mode & SORT_DESCENDING);
+      continue;
+    }
+    for(i=lo+1: i<=hi: i++) {
+      vi=index-->i;
+      v=arr-->vi;
+      if(comp)
+        for(j=i: j>lo && comp(arr-->(index-->(j-1)), v): j--)
+          index-->j=index-->(j-1);
+      else
+        for(j=i: j>lo && arr-->(index-->(j-1)) > v: j--)
+          index-->j=index-->(j-1);
+      #Ifdef SORTING_STATS;
+      sort_stat_moves=sort_stat_moves+i-j;
+      #Endif;
+      index-->j=vi;
+    }
+  }
+  for(w=MERGESORTRUN: w<=to-from: w=w+w)
+    for(lo=from: lo+w<=to: lo=lo+w+w) {
+      hi=lo+w+w-1;
+      if(hi>to)
+        hi=to;
+      if(mode)
+        _msmi_merge(arr, index, scratch, lo, lo+w, hi, mode);
+      else if(comp)
+        _msgi_merge(arr, index, scratch, lo, lo+w, hi, comp);
+      else
+        _mswi_merge(arr, index, scratch, lo, lo+w, hi);
+    }
+];
+
+#Endif; ! Not NOWORDSORT;
+
+#Endif; ! Not NOINDEXSORT;
+
+
+!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!
+! Direct MergeSort routines.
+!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!
+
+#Ifndef NODIRECTSORT;
+
+#Ifndef NOBYTESORT;
+
+[ _msb_merge arr scratch lo mid hi   i j k n;
+  #Ifdef SORTING_STATS;
+  sort_stat_compares++;
+  #Endif;
+  if(arr->(mid-1) <= arr->mid)
+    return;
+  n=mid-lo;
+  #Ifdef TARGET_GLULX;
+  j=arr+lo;
+  @mcopy n j scratch;
+  #Ifnot;
+  for(i=0: i<n: i++)
+    scratch->i=arr->(lo+i);
+  #Endif;
+  for(i=0, j=mid, k=lo: i<n && j<=hi: k++)
+    if(scratch->i > arr->j)
+      arr->k=arr->(j++);
+    else
+      arr->k=scratch->(i++);
+  #Ifdef SORTING_STATS;
+  sort_stat_compares=sort_stat_compares+k-lo;
+  sort_stat_moves=sort_stat_moves+n+k-lo+n-i;
+  #Endif;
+  #Ifdef TARGET_GLULX;
+  if(i<n) {
+    n=n-i;
+    i=scratch+i;
+    k=arr+k;
+    @mcopy n i k;
+  }
+  #Ifnot;
+  for(: i<n: i++, k++)
+    arr->k=scratch->i;
+  #Endif;
+];
+
+[ msort_bytes arr scratch from to   i j v lo hi w;
+  if(to<=from)
+    return;
+  #Ifdef TARGET_GLULX;
+  if(scratch==0) {
+    scratch=_sort_malloc(to-from+1);
+    if(scratch) {
+      msort_bytes(arr, scratch, from, to);
+      @mfree scratch;
+      return;
+    }
+  }
+  #Endif;
+  #Ifndef NOCOUNTSORT;
+  if(scratch==0)
+    return countsort_bytes(arr, from, to);
+  #Endif;
+  w=MERGESORTRUN;
+  if(scratch==0)
+    w=to-from+1;
+  for(lo=from: lo<=to: lo=lo+w) {
+    hi=lo+w-1;
+    if(hi>to)
+      hi=to;
+    for(i=lo+1: i<=hi: i++) {
+      v=arr->i;
+      for(j=i: j>lo && arr->(j-1) > v: j--)
+        arr->j=arr->(j-1);
+      #Ifdef SORTING_STATS;
+      sort_stat_moves=sort_stat_moves+i-j;
+      sort_stat_compares=sort_stat_compares+i-j+(j>lo);
+      #Endif;
+      arr->j=v;
+    }
+  }
+  if(scratch)
+    for(w=MERGESORTRUN: w<=to-from: w=w+w)
+      for(lo=from: lo+w<=to: lo=lo+w+w) {
+        hi=lo+w+w-1;
+        if(hi>to)
+          hi=to;
+        _msb_merge(arr, scratch, lo, lo+w, hi);
+      }
+];
+
+#Endif; ! Not NOBYTESORT;
+
+#Ifndef NOWORDSORT;
+
+[ _msw_merge arr scratch lo mid hi   i j k n;
+  if(arr-->(mid-1) <= arr-->mid)
+    return;
+  n=mid-lo;
+  #Ifdef TARGET_GLULX;
+  i=n*WORDSIZE;
+  j=arr+lo*WORDSIZE;
+  @mcopy i j scratch;
+  #Ifnot;
+  for(i=0: i<n: i++)
+    scratch-->i=arr-->(lo+i);
+  #Endif;
+  for(i=0, j=mid, k=lo: i<n && j<=hi: k++)
+    if(scratch-->i > arr-->j)
+      arr-->k=arr-->(j++);
+    else
+      arr-->k=scratch-->(i++);
+  #Ifdef TARGET_GLULX;
+  if(i<n) {
+    n=(n-i)*WORDSIZE;
+    i=scratch+i*WORDSIZE;
+    k=arr+k*WORDSIZE;
+    @mcopy n i k;
+  }
+  #Ifnot;
+  for(: i<n: i++, k++)
+    arr-->k=scratch-->i;
+  #Endif;
+];
+
+[ _msg_merge arr scratch lo mid hi comp   i j k n;
+  if(~~comp(arr-->(mid-1), arr-->mid))
+    return;
+  n=mid-lo;
+  #Ifdef TARGET_GLULX;
+  i=n*WORDSIZE;
+  j=arr+lo*WORDSIZE;
+  @mcopy i j scratch;
+  #Ifnot;
+  for(i=0: i<n: i++)
+    scratch-->i=arr-->(lo+i);
+  #Endif;
+  for(i=0, j=mid, k=lo: i<n && j<=hi: k++)
+    if(comp(scratch-->i, arr-->j))
+      arr-->k=arr-->(j++);
+    else
+      arr-->k=scratch-->(i++);
+  #Ifdef SORTING_STATS;
+  sort_stat_moves=sort_stat_moves+n+k-lo+n-i;
+  #Endif;
+  #Ifdef TARGET_GLULX;
+  if(i<n) {
+    n=(n-i)*WORDSIZE;
+    i=scratch+i*WORDSIZE;
+    k=arr+k*WORDSIZE;
+    @mcopy n i k;
+  }
+  #Ifnot;
+  for(: i<n: i++, k++)
+    arr-->k=scratch-->i;
+  #Endif;
+];
+
+[ msort_words arr scratch from to comp   i j v lo hi w;
+  if(comp>0 && comp<_SORT_MODES) {
+    _sort_flip(arr, from, to, comp);
+    msort_words(arr, scratch, from, to);
+    _sort_flip(arr, from, to, comp);
+    return;
+  }
+  #Ifdef SORTING_STATS;
+  comp=_sort_stat_wrap(comp);
+  #Endif;
+  if(to<=from)
+    return;
+  #Ifdef TARGET_GLULX;
+  if(scratch==0) {
+    scratch=_sort_malloc((to-from+1)*WORDSIZE);
+    if(scratch) {
+      msort_words(arr, scratch, from, to, comp);
+      @mfree scratch;
+      return;
+    }
+  }
+  #Endif;
+  if(scratch==0)
+    return ipsort_words(arr, from, to, comp);
+  w=MERGESORTRUN;
+  for(lo=from: lo<=to: lo=lo+w) {
+    hi=lo+w-1;
+    if(hi>to)
+      hi=to;
+    for(i=lo+1: i<=hi: i++) {
+      v=arr-->i;
+      if(comp)
+        for(j=i: j>lo && comp(arr-->(j-1), v): j--)
+          arr-->j=arr-->(j-1);
+      else
+        for(j=i: j>lo && arr-->(j-1) > v: j--)
+          arr-->j=arr-->(j-1);
+      #Ifdef SORTING_STATS;
+      sort_stat_moves=sort_stat_moves+i-j;
+      #Endif;
+      arr-->j=v;
+    }
+  }
+  for(w=MERGESORTRUN: w<=to-from: w=w+w)
+    for(lo=from: lo+w<=to: lo=lo+w+w) {
+      hi=lo+w+w-1;
+      if(hi>to)
+        hi=to;
+      if(comp)
+        _msg_merge(arr, scratch, lo, lo+w, hi, comp);
+      else
+        _msw_merge(arr, scratch, lo, lo+w, hi);
+    }
+];
+
+#Endif; ! Not NOWORDSORT;
+
+#Endif; ! Not NODIRECTSORT;
+
+!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!
+! Natural MergeSort (TimSort) routines.
+!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!
+
+! TimSort works on the array dat, which is the data itself for tsort_words
+! and the index for tsort_words_idx. In the latter case _ts_arr holds the
+! data array, and the elements of dat are looked up there before they are
+! compared. The run stack holds the start and length of each run that
+! hasn't been merged yet.
+
+#Ifndef NOWORDSORT;
+
+Constant _TS_MINGALLOP 7;
+
+Array _ts_base --> 40;
+Array _ts_len --> 40;
+Global _ts_sp;
+Global _ts_arr;
+Global _ts_comp;
+Global _ts_u;
+Global _ts_d;
+
+! _ts_u and _ts_d stand for a mode given to an index-based sort, as u and d
+! do for the mode-aware cores. They are 0 for the direct sorts, which
+! change the data instead.
+[ _ts_after a b;
+  if(_ts_arr) {
+    a=_ts_arr-->a;
+    b=_ts_arr-->b;
+  }
+  if(_ts_comp)
+    return _ts_comp(a, b);
+  if(_ts_d)
+    return a+_ts_u < b+_ts_u;
+  return a+_ts_u > b+_ts_u;
+];
+
+! Returns the first position p in lo..hi+1 such that the elements a-->p to
+! a-->hi are all after v, if right is set, or all not before v, if it isn't.
+! The search starts at lo, or at hi if back is set, and takes steps that
+! double in size until it has passed p, which makes it very fast when p is
+! close to where it started, and never much slower than a binary search.
+[ _ts_gallop v a lo hi right back   ofs p lo2 hi2;
+  ofs=1;
+  if(back) {
+    hi2=hi+1;
+    for(p=hi: p>=lo: p=hi-ofs+1) {
+      if(right) {
+        if(~~_ts_after(a-->p, v))
+          break;
+      } else if(_ts_after(v, a-->p))
+        break;
+      hi2=p;
+      ofs=ofs+ofs;
+    }
+    lo2=p+1;
+    if(lo2<lo)
+      lo2=lo;
+  } else {
+    lo2=lo;
+    for(p=lo: p<=hi: p=lo+ofs-1) {
+      if(right) {
+        if(_ts_after(a-->p, v))
+          break;
+      } else if(~~_ts_after(v, a-->p))
+        break;
+      lo2=p+1;
+      ofs=ofs+ofs;
+    }
+    hi2=p;
+    if(hi2>hi+1)
+      hi2=hi+1;
+  }
+  while(lo2<hi2) {
+    p=lo2+(hi2-lo2)/2;
+    if(right) {
+      if(_ts_after(a-->p, v))
+        hi2=p;
+      else
+        lo2=p+1;
+    } else if(_ts_after(v, a-->p))
+      lo2=p+1;
+    else
+      hi2=p;
+  }
+  return lo2;
+];
+
+! _ts_merge_lo merges lo..mid-1 and mid..hi from the left, with the left run
+! copied out to scratch, and _ts_merge_hi merges them from the right, with
+! the right run copied out. When one run has supplied _TS_MINGALLOP elements
+! in a row, the merge gallops to find how many more it can take from that
+! run, and moves them all at once.
+
+[ _ts_merge_lo dat scratch lo mid hi   i j k n p ca cb;
+  n=mid-lo;
+  _sort_copy(dat+lo*WORDSIZE, scratch, n);
+  for(i=0, j=mid, k=lo: i<n && j<=hi: ) {
+    if(_ts_after(scratch-->i, dat-->j)) {
+      dat-->(k++)=dat-->(j++);
+      ca=0;
+      if(++cb>=_TS_MINGALLOP) {
+        p=_ts_gallop(scratch-->i, dat, j, hi, 0, 0);
+        _sort_copy(dat+j*WORDSIZE, dat+k*WORDSIZE, p-j);
+        k=k+p-j;
+        j=p;
+        cb=0;
+      }
+    } else {
+      dat-->(k++)=scratch-->(i++);
+      cb=0;
+      if(++ca>=_TS_MINGALLOP) {
+        p=_ts_gallop(dat-->j, scratch, i, n-1, 1, 0);
+        _sort_copy(scratch+i*WORDSIZE, dat+k*WORDSIZE, p-i);
+        k=k+p-i;
+        i=p;
+        ca=0;
+      }
+    }
+  }
+  #Ifdef SORTING_STATS;
+  sort_stat_moves=sort_stat_moves+n+k-lo+n-i;
+  #Endif;
+  _sort_copy(scratch+i*WORDSIZE, dat+k*WORDSIZE, n-i);
+];
+
+[ _ts_merge_hi dat scratch lo mid hi   i j k p ca cb;
+  _sort_copy(dat+mid*WORDSIZE, scratch, hi-mid+1);
+  for(i=hi-mid, j=mid-1, k=hi: i>=0 && j>=lo: ) {
+    if(_ts_after(dat-->j, scratch-->i)) {
+      dat-->(k--)=dat-->(j--);
+      cb=0;
+      if(++ca>=_TS_MINGALLOP && j>=lo) {
+        p=_ts_gallop(scratch-->i, dat, lo, j, 1, 1);
+        k=k-(j-p+1);
+        _sort_copy(dat+p*WORDSIZE, dat+(k+1)*WORDSIZE, j-p+1);
+        j=p-1;
+        ca=0;
+      }
+    } else {
+      dat-->(k--)=scratch-->(i--);
+      ca=0;
+      if(++cb>=_TS_MINGALLOP && i>=0) {
+        p=_ts_gallop(dat-->j, scratch, 0, i, 0, 1);
+        k=k-(i-p+1);
+        _sort_copy(scratch+p*WORDSIZE, dat+(k+1)*WORDSIZE, i-p+1);
+        i=p-1;
+        cb=0;
+      }
+    }
+  }
+  #Ifdef SORTING_STATS;
+  sort_stat_moves=sort_stat_moves+hi-mid+1+hi-k+i+1;
+  #Endif;
+  _sort_copy(scratch, dat+(k-i)*WORDSIZE, i+1);
+];
+
+! Merges run n with run n+1 on the stack. The elements at the start of the
+! left run that go before the whole right run, and the elements at the end
+! of the right run that go after the whole left run, are already in place,
+! and the rest is merged from the side of the shorter run.
+[ _ts_merge_at dat scratch n   lo mid hi;
+  lo=_ts_base-->n;
+  mid=_ts_base-->(n+1);
+  hi=mid+_ts_len-->(n+1)-1;
+  _ts_len-->n=_ts_len-->n+_ts_len-->(n+1);
+  if(n==_ts_sp-3) {
+    _ts_base-->(n+1)=_ts_base-->(n+2);
+    _ts_len-->(n+1)=_ts_len-->(n+2);
+  }
+  _ts_sp--;
+  lo=_ts_gallop(dat-->mid, dat, lo, mid-1, 1, 0);
+  if(lo==mid)
+    return;
+  hi=_ts_gallop(dat-->(mid-1), dat, mid, hi, 0, 1)-1;
+  if(mid-lo<=hi-mid+1)
+    _ts_merge_lo(dat, scratch, lo, mid, hi);
+  else
+    _ts_merge_hi(dat, scratch, lo, mid, hi);
+];
+
+! Each run is either the longest non-descending sequence that starts at lo,
+! or the longest strictly descending one, which is turned around. Runs that
+! are shorter than MERGESORTRUN are made longer with InsertionSort. The run
+! stack is kept so that each run is longer than the two above it together,
+! which keeps the merges balanced and the stack short.
+[ _ts_sort dat scratch from to   lo hi i j v n;
+  _ts_sp=0;
+  for(lo=from: lo<=to: lo=hi+1) {
+    hi=lo;
+    if(lo<to) {
+      hi=lo+1;
+      if(_ts_after(dat-->lo, dat-->hi)) {
+        while(hi<to && _ts_after(dat-->hi, dat-->(hi+1)))
+          hi++;
+        for(i=lo, j=hi: i<j: i++, j--) {
+          v=dat-->i;
+          dat-->i=dat-->j;
+          dat-->j=v;
+        }
+        #Ifdef SORTING_STATS;
+        sort_stat_moves=sort_stat_moves+(hi-lo+1)/2*2;
+        #Endif;
+      } else
+        while(hi<to && ~~_ts_after(dat-->hi, dat-->(hi+1)))
+          hi++;
+    }
+    n=lo+MERGESORTRUN-1;
+    if(n>to)
+      n=to;
+    for(i=hi+1: i<=n: i++) {
+      v=dat-->i;
+      for(j=i: j>lo && _ts_after(dat-->(j-1), v): j--)
+        dat-->j=dat-->(j-1);
+      #Ifdef SORTING_STATS;
+      sort_stat_moves=sort_stat_moves+i-j;
+      #Endif;
+      dat-->j=v;
+    }
+    if(hi<n)
+      hi=n;
+    _ts_base-->_ts_sp=lo;
+    _ts_len-->_ts_sp=hi-lo+1;
+    _ts_sp++;
+    while(_ts_sp>1) {
+      n=_ts_sp-2;
+      if((n>0 && _ts_len-->(n-1) <= _ts_len-->n+_ts_len-->(n+1)) ||
+          (n>1 && _ts_len-->(n-2) <= _ts_len-->(n-1)+_ts_len-->n)) {
+        if(_ts_len-->(n-1) < _ts_len-->(n+1))
+          n--;
+      } else if(_ts_len-->n > _ts_len-->(n+1))
+        break;
+      _ts_merge_at(dat, scratch, n);
+    }
+  }
+  while(_ts_sp>1) {
+    n=_ts_sp-2;
+    if(n>0 && _ts_len-->(n-1) < _ts_len-->(n+1))
+      n--;
+    _ts_merge_at(dat, scratch, n);
+  }
+];
+
+#Ifndef NOINDEXSORT;
+
+[ tsort_words_idx arr index scratch from to comp   i;
+  #Ifdef SORTING_STATS;
+  comp=_sort_stat_wrap(comp);
+  #Endif;
+  #Ifdef TARGET_GLULX;
+  if(scratch==0 && to>from) {
+    scratch=_sort_malloc(((to-from)/2+1)*WORDSIZE);
+    if(scratch) {
+      tsort_words_idx(arr, index, scratch, from, to, comp);
+      @mfree scratch;
+      return;
+    }
+  }
+  #Endif;
+  if(scratch==0)
+    return ipsort_words_idx(arr, index, from, to, comp);
+  for(i=from:i<=to:i++)
+    index-->i=i;
+  _ts_u=0;
+  _ts_d=0;
+  #Ifndef SORTING_STATS;
+  if(comp>0 && comp<_SORT_MODES) {
+    _ts_u=(comp & SORT_UNSIGNED)*_SORT_HIGHBIT;
+    _ts_d=comp & SORT_DESCENDING;
+    comp=0;
+  }
+  #Endif;
+  _ts_arr=arr;
+  _ts_comp=comp;
+  _ts_sort(index, scratch, from, to);
+];
+
+#Endif; ! Not NOINDEXSORT;
+
+#Ifndef NODIRECTSORT;
+
+[ tsort_words arr scratch from to comp;
+  if(comp>0 && comp<_SORT_MODES) {
+    _sort_flip(arr, from, to, comp);
+    tsort_words(arr, scratch, from, to);
+    _sort_flip(arr, from, to, comp);
+    return;
+  }
+  #Ifdef SORTING_STATS;
+  comp=_sort_stat_wrap(comp);
+  #Endif;
+  #Ifdef TARGET_GLULX;
+  if(scratch==0 && to>from) {
+    scratch=_sort_malloc(((to-from)/2+1)*WORDSIZE);
+    if(scratch) {
+      tsort_words(arr, scratch, from, to, comp);
+      @mfree scratch;
+      return;
+    }
+  }
+  #Endif;
+  if(scratch==0)
+    return ipsort_words(arr, from, to, comp);
+  _ts_arr=0;
+  _ts_comp=comp;
+  _ts_u=0;
+  _ts_d=0;
+  _ts_sort(arr, scratch, from, to);
+];
+
+#Endif; ! Not NODIRECTSORT;
+
+!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!
+! In-place MergeSort routines.
+!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!
+
+! These work on dat and compare with _ts_after, just like TimSort. The runs
+! are merged with the SymMerge algorithm (Kim and Kutzner): _ip_merge finds
+! a split point in each run such that rotating the part between the two
+! split points leaves two smaller merges, one on each side of the middle,
+! which it then does the same way. A run of a single element is put in its
+! place with a binary search instead.
+
+[ _ip_reverse dat lo hi   v;
+  #Ifdef SORTING_STATS;
+  if(hi>lo)
+    sort_stat_moves=sort_stat_moves+(hi-lo+1)/2*2;
+  #Endif;
+  for(: lo<hi: lo++, hi--) {
+    v=dat-->lo;
+    dat-->lo=dat-->hi;
+    dat-->hi=v;
+  }
+];
+
+! Merges the sorted runs a..m-1 and m..b-1.
+[ _ip_merge dat a m b   i j h v mid n;
+  if(m-a==1) {
+    v=dat-->a;
+    i=m;
+    j=b;
+    while(i<j) {
+      h=i+(j-i)/2;
+      if(_ts_after(v, dat-->h))
+        i=h+1;
+      else
+        j=h;
+    }
+    #Ifdef SORTING_STATS;
+    sort_stat_moves=sort_stat_moves+i-a;
+    #Endif;
+    _sort_copy(dat+(a+1)*WORDSIZE, dat+a*WORDSIZE, i-1-a);
+    dat-->(i-1)=v;
+    return;
+  }
+  if(b-m==1) {
+    v=dat-->m;
+    i=a;
+    j=m;
+    while(i<j) {
+      h=i+(j-i)/2;
+      if(_ts_after(dat-->h, v))
+        j=h;
+      else
+        i=h+1;
+    }
+    #Ifdef SORTING_STATS;
+    sort_stat_moves=sort_stat_moves+m-i+1;
+    #Endif;
+    _sort_copy(dat+i*WORDSIZE, dat+(i+1)*WORDSIZE, m-i);
+    dat-->i=v;
+    return;
+  }
+  ! Search for the split point i in the left run. Rotating i..m-1 with
+  ! m..n-i-1 then puts everything that belongs before position mid before it.
+  mid=a+(b-a)/2;
+  n=mid+m;
+  if(m>mid) {
+    i=n-b;
+    j=mid;
+  } else {
+    i=a;
+    j=m;
+  }
+  while(i<j) {
+    h=i+(j-i)/2;
+    if(_ts_after(dat-->h, dat-->(n-1-h)))
+      j=h;
+    else
+      i=h+1;
+  }
+  j=n-i;
+  if(i<m && m<j) {
+    _ip_reverse(dat, i, m-1);
+    _ip_reverse(dat, m, j-1);
+    _ip_reverse(dat, i, j-1);
+  }
+  if(a<i && i<mid)
+    _ip_merge(dat, a, i, mid);
+  if(mid<j && j<b)
+    _ip_merge(dat, mid, j, b);
+];
+
+[ _ip_sort dat from to   lo hi i j v w;
+  for(lo=from: lo<=to: lo=lo+MERGESORTRUN) {
+    hi=lo+MERGESORTRUN-1;
+    if(hi>to)
+      hi=to;
+    for(i=lo+1: i<=hi: i++) {
+      v=dat-->i;
+      for(j=i: j>lo && _ts_after(dat-->(j-1), v): j--)
+        dat-->j=dat-->(j-1);
+      #Ifdef SORTING_STATS;
+      sort_stat_moves=sort_stat_moves+i-j;
+      #Endif;
+      dat-->j=v;
+    }
+  }
+  for(w=MERGESORTRUN: w<=to-from: w=w+w)
+    for(lo=from: lo+w<=to: lo=lo+w+w) {
+      hi=lo+w+w;
+      if(hi>to+1)
+        hi=to+1;
+      if(_ts_after(dat-->(lo+w-1), dat-->(lo+w)))
+        _ip_merge(dat, lo, lo+w, hi);
+    }
+];
+
+#Ifndef NOINDEXSORT;
+
+[ ipsort_words_idx arr index from to comp   i;
+  _ts_u=0;
+  _ts_d=0;
+  #Ifdef SORTING_STATS;
+  comp=_sort_stat_wrap(comp);
+  #Ifnot;
+  if(comp>0 && comp<_SORT_MODES) {
+    _ts_u=(comp & SORT_UNSIGNED)*_SORT_HIGHBIT;
+    _ts_d=comp & SORT_DESCENDING;
+    comp=0;
+  }
+  #Endif;
+  for(i=from:i<=to:i++)
+    index-->i=i;
+  _ts_arr=arr;
+  _ts_comp=comp;
+  _ip_sort(index, from, to);
+];
+
+#Endif; ! Not NOINDEXSORT;
+
+#Ifndef NODIRECTSORT;
+
+[ ipsort_words arr from to comp;
+  if(comp>0 && comp<_SORT_MODES) {
+    _sort_flip(arr, from, to, comp);
+    ipsort_words(arr, from, to);
+    _sort_flip(arr, from, to, comp);
+    return;
+  }
+  #Ifdef SORTING_STATS;
+  comp=_sort_stat_wrap(comp);
+  #Endif;
+  _ts_arr=0;
+  _ts_comp=comp;
+  _ts_u=0;
+  _ts_d=0;
+  _ip_sort(arr, from, to);
+];
+
+#Endif; ! Not NODIRECTSORT;
+
+#Endif; ! Not NOWORDSORT;
+
+#Endif; ! Not NOMERGESORT
+
+
+
+#Ifndef NOSTRINGSORT;
+#Ifndef NOWORDSORT;
+
+Default STRSORTLIMIT 8;
+
+Constant STRSORT_STRING 1;
+Constant STRSORT_BUFFER 2;
+Constant STRSORT_DICT 3;
+Constant STRSORT_FOLD 16;
+
+!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!
+! String sort routines (multikey QuickSort).
+!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!
+
+Global _ss_mode;
+Global _ss_fold;
+
+#Ifdef TARGET_ZCODE;
+#IfV3;
+Constant _SS_DICTLEN 4;
+#Ifnot;
+Constant _SS_DICTLEN 6;
+#Endif;
+#Endif;
+
+! Returns character d (counting from 0) of the string s, or 0 if the string
+! is shorter than that. Z-machine dictionary words are compared as their
+! encoded bytes, which keeps them in alphabetical order.
+[ _ss_char s d   c;
+  switch(_ss_mode) {
+    STRSORT_STRING:
+      if(d>=s->0)
+        return 0;
+      c=s->(d+1);
+    STRSORT_BUFFER:
+      if(d>=s-->0)
+        return 0;
+      c=s->(d+WORDSIZE);
+    default:
+      #Ifdef TARGET_GLULX;
+      if(d>=DICT_WORD_SIZE)
+        return 0;
+      #Iftrue DICT_CHAR_SIZE == 1;
+      c=s->(d+1);
+      #Ifnot;
+      c=(s+4)-->d;
+      #Endif;
+      #Ifnot;
+      if(d>=_SS_DICTLEN)
+        return 0;
+      return s->d;
+      #Endif;
+  }
+  if(_ss_fold && c>='A' && c<='Z')
+    c=c+32;
+  return c;
+];
+
+! Compares two strings, knowing that the first d characters are equal.
+[ _ss_cmp a b d   ca cb;
+  #Ifdef SORTING_STATS;
+  sort_stat_compares++;
+  #Endif;
+  for(::d++) {
+    ca=_ss_char(a, d);
+    cb=_ss_char(b, d);
+    if(ca~=cb)
+      return ca-cb;
+    if(ca==0)
+      return 0;
+  }
+];
+
+! The multikey QuickSort cores split the strings three ways on character d
+! of a pivot string: those with a smaller character, those with the same,
+! and those with a larger one. Only the middle part goes on to character
+! d+1, so each character is looked at about once. They recurse on the two
+! smaller parts and loop on the largest, so the recursion is never more
+! than log2(n) deep, whatever the strings are.
+
+#Ifndef NOINDEXSORT;
+
+[ _mkqi_sub arr index from to d   i j lt gt v c t;
+  while(to>from) {
+    if(to-from<STRSORTLIMIT) {
+      for(i=from+1: i<=to: i++) {
+        t=index-->i;
+        v=arr-->t;
+        for(j=i: j>from && _ss_cmp(arr-->(index-->(j-1)), v, d)>0: j--)
+          index-->j=index-->(j-1);
+        #Ifdef SORTING_STATS;
+        sort_stat_moves=sort_stat_moves+i-j;
+        #Endif;
+        index-->j=t;
+      }
+      return;
+    }
+    i=from+(to-from)/2;
+    t=index-->i;
+    index-->i=index-->from;
+    index-->from=t;
+    v=_ss_char(arr-->(index-->from), d);
+    lt=from;
+    gt=to;
+    for(i=from+1: i<=gt: ) {
+      t=index-->i;
+      c=_ss_char(arr-->t, d);
+      if(c<v) {
+        index-->i=index-->lt;
+        index-->lt=t;
+        lt++;
+        i++;
+      } else if(c>v) {
+        index-->i=index-->gt;
+        index-->gt=t;
+        gt--;
+      } else
+        i++;
+    }
+    #Ifdef SORTING_STATS;
+    sort_stat_compares=sort_stat_compares+2*(to-from)-(lt-from);
+    sort_stat_moves=sort_stat_moves+2*(lt-from+to-gt);
+    #Endif;
+    i=lt-from;
+    j=to-gt;
+    c=0;
+    if(v)
+      c=gt-lt+1;
+    if(i>=j && i>=c) {
+      _mkqi_sub(arr, index, gt+1, to, d);
+      if(v)
+        _mkqi_sub(arr, index, lt, gt, d+1);
+      to=lt-1;
+    } else if(j>=c) {
+      _mkqi_sub(arr, index, from, lt-1, d);
+      if(v)
+        _mkqi_sub(arr, index, lt, gt, d+1);
+      from=gt+1;
+    } else {
+      _mkqi_sub(arr, index, from, lt-1, d);
+      _mkqi_sub(arr, index, gt+1, to, d);
+      from=lt;
+      to=gt;
+      d++;
+    }
+  }
+];
+
+[ strsort_idx arr index from to mode   i;
+  for(i=from:i<=to:i++)
+    index-->i=i;
+  _ss_fold=mode & STRSORT_FOLD;
+  _ss_mode=mode-_ss_fold;
+  _mkqi_sub(arr, index, from, to, 0);
+];
+
+#Endif; ! Not NOINDEXSORT;
+
+#Ifndef NODIRECTSORT;
+
+[ _mkq_sub arr from to d   i j lt gt v c t;
+  while(to>from) {
+    if(to-from<STRSORTLIMIT) {
+      for(i=from+1: i<=to: i++) {
+        t=arr-->i;
+        for(j=i: j>from && _ss_cmp(arr-->(j-1), t, d)>0: j--)
+          arr-->j=arr-->(j-1);
+        #Ifdef SORTING_STATS;
+        sort_stat_moves=sort_stat_moves+i-j;
+        #Endif;
+        arr-->j=t;
+      }
+      return;
+    }
+    i=from+(to-from)/2;
+    t=arr-->i;
+    arr-->i=arr-->from;
+    arr-->from=t;
+    v=_ss_char(arr-->from, d);
+    lt=from;
+    gt=to;
+    for(i=from+1: i<=gt: ) {
+      t=arr-->i;
+      c=_ss_char(t, d);
+      if(c<v) {
+        arr-->i=arr-->lt;
+        arr-->lt=t;
+        lt++;
+        i++;
+      } else if(c>v) {
+        arr-->i=arr-->gt;
+        arr-->gt=t;
+        gt--;
+      } else
+        i++;
+    }
+    #Ifdef SORTING_STATS;
+    sort_stat_compares=sort_stat_compares+2*(to-from)-(lt-from);
+    sort_stat_moves=sort_stat_moves+2*(lt-from+to-gt);
+    #Endif;
+    i=lt-from;
+    j=to-gt;
+    c=0;
+    if(v)
+      c=gt-lt+1;
+    if(i>=j && i>=c) {
+      _mkq_sub(arr, gt+1, to, d);
+      if(v)
+        _mkq_sub(arr, lt, gt, d+1);
+      to=lt-1;
+    } else if(j>=c) {
+      _mkq_sub(arr, from, lt-1, d);
+      if(v)
+        _mkq_sub(arr, lt, gt, d+1);
+      from=gt+1;
+    } else {
+      _mkq_sub(arr, from, lt-1, d);
+      _mkq_sub(arr, gt+1, to, d);
+      from=lt;
+      to=gt;
+      d++;
+    }
+  }
+];
+
+[ strsort arr from to mode;
+  _ss_fold=mode & STRSORT_FOLD;
+  _ss_mode=mode-_ss_fold;
+  _mkq_sub(arr, from, to, 0);
+];
+
+#Endif; ! Not NODIRECTSORT;
+
+#Endif; ! Not NOWORDSORT;
+#Endif; ! Not NOSTRINGSORT
+
+
+
+#Ifndef NOSEARCH;
+
+!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!
+! Binary search routines.
+!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!
+
+Global sort_range_end;
+
+! lower_bound returns the position of the first element in from..to that
+! doesn't belong before v, and upper_bound the position of the first one
+! that belongs after v. Both return to+1 if there is no such element.
+
+#Ifndef NOINDEXSORT;
+#Ifndef NOBYTESORT;
+
+[ lower_bound_bytes_idx arr index from to v   m;
+  to++;
+  while(from<to) {
+    m=from+(to-from)/2;
+    #Ifdef SORTING_STATS;
+    sort_stat_compares++;
+    #Endif;
+    if(arr->(index-->m) < v)
+      from=m+1;
+    else
+      to=m;
+  }
+  return from;
+];
+
+[ upper_bound_bytes_idx arr index from to v   m;
+  to++;
+  while(from<to) {
+    m=from+(to-from)/2;
+    #Ifdef SORTING_STATS;
+    sort_stat_compares++;
+    #Endif;
+    if(arr->(index-->m) > v)
+      to=m;
+    else
+      from=m+1;
+  }
+  return from;
+];
+
+[ equal_range_bytes_idx arr index from to v;
+  sort_range_end=upper_bound_bytes_idx(arr, index, from, to, v);
+  return lower_bound_bytes_idx(arr, index, from, sort_range_end-1, v);
+];
+
+#Endif; ! Not NOBYTESORT;
+
+#Ifndef NOWORDSORT;
+
+[ lower_bound_words_idx arr index from to v comp   m u d w;
+  #Ifdef SORTING_STATS;
+  comp=_sort_stat_wrap(comp);
+  #Ifnot;
+  if(comp>0 && comp<_SORT_MODES) {
+    u=(comp & SORT_UNSIGNED)*_SORT_HIGHBIT;
+    d=comp & SORT_DESCENDING;
+    comp=0;
+  }
+  #Endif;
+  v=v+u;
+  if(d)
+    v=~v;
+  to++;
+  while(from<to) {
+    m=from+(to-from)/2;
+    if(comp) {
+      if(comp(v, arr-->(index-->m)))
+        from=m+1;
+      else
+        to=m;
+      continue;
+    }
+    w=arr-->(index-->m)+u;
+    if(d)
+      w=~w;
+    if(w < v)
+      from=m+1;
+    else
+      to=m;
+  }
+  return from;
+];
+
+[ upper_bound_words_idx arr index from to v comp   m u d w;
+  #Ifdef SORTING_STATS;
+  comp=_sort_stat_wrap(comp);
+  #Ifnot;
+  if(comp>0 && comp<_SORT_MODES) {
+    u=(comp & SORT_UNSIGNED)*_SORT_HIGHBIT;
+    d=comp & SORT_DESCENDING;
+    comp=0;
+  }
+  #Endif;
+  v=v+u;
+  if(d)
+    v=~v;
+  to++;
+  while(from<to) {
+    m=from+(to-from)/2;
+    if(comp) {
+      if(comp(arr-->(index-->m), v))
+        to=m;
+      else
+        from=m+1;
+      continue;
+    }
+    w=arr-->(index-->m)+u;
+    if(d)
+      w=~w;
+    if(w > v)
+      to=m;
+    else
+      from=m+1;
+  }
+  return from;
+];
+
+[ equal_range_words_idx arr index from to v comp;
+  #Ifdef SORTING_STATS;
+  comp=_sort_stat_wrap(comp);
+  #Endif;
+  sort_range_end=upper_bound_words_idx(arr, index, from, to, v, comp);
+  return lower_bound_words_idx(arr, index, from, sort_range_end-1, v, comp);
+];
+
+#Endif; ! Not NOWORDSORT;
+#Endif; ! Not NOINDEXSORT;
+
+#Ifndef NODIRECTSORT;
+#Ifndef NOBYTESORT;
+
+[ lower_bound_bytes arr from to v   m;
+  to++;
+  while(from<to) {
+    m=from+(to-from)/2;
+    #Ifdef SORTING_STATS;
+    sort_stat_compares++;
+    #Endif;
+    if(arr->m < v)
+      from=m+1;
+    else
+      to=m;
+  }
+  return from;
+];
+
+[ upper_bound_bytes arr from to v   m;
+  to++;
+  while(from<to) {
+    m=from+(to-from)/2;
+    #Ifdef SORTING_STATS;
+    sort_stat_compares++;
+    #Endif;
+    if(arr->m > v)
+      to=m;
+    else
+      from=m+1;
+  }
+  return from;
+];
+
+[ equal_range_bytes arr from to v;
+  sort_range_end=upper_bound_bytes(arr, from, to, v);
+  return lower_bound_bytes(arr, from, sort_range_end-1, v);
+];
+
+#Endif; ! Not NOBYTESORT;
+
+#Ifndef NOWORDSORT;
+
+[ lower_bound_words arr from to v comp   m u d w;
+  #Ifdef SORTING_STATS;
+  comp=_sort_stat_wrap(comp);
+  #Ifnot;
+  if(comp>0 && comp<_SORT_MODES) {
+    u=(comp & SORT_UNSIGNED)*_SORT_HIGHBIT;
+    d=comp & SORT_DESCENDING;
+    comp=0;
+  }
+  #Endif;
+  v=v+u;
+  if(d)
+    v=~v;
+  to++;
+  while(from<to) {
+    m=from+(to-from)/2;
+    if(comp) {
+      if(comp(v, arr-->m))
+        from=m+1;
+      else
+        to=m;
+      continue;
+    }
+    w=arr-->m+u;
+    if(d)
+      w=~w;
+    if(w < v)
+      from=m+1;
+    else
+      to=m;
+  }
+  return from;
+];
+
+[ upper_bound_words arr from to v comp   m u d w;
+  #Ifdef SORTING_STATS;
+  comp=_sort_stat_wrap(comp);
+  #Ifnot;
+  if(comp>0 && comp<_SORT_MODES) {
+    u=(comp & SORT_UNSIGNED)*_SORT_HIGHBIT;
+    d=comp & SORT_DESCENDING;
+    comp=0;
+  }
+  #Endif;
+  v=v+u;
+  if(d)
+    v=~v;
+  to++;
+  while(from<to) {
+    m=from+(to-from)/2;
+    if(comp) {
+      if(comp(arr-->m, v))
+        to=m;
+      else
+        from=m+1;
+      continue;
+    }
+    w=arr-->m+u;
+    if(d)
+      w=~w;
+    if(w > v)
+      to=m;
+    else
+      from=m+1;
+  }
+  return from;
+];
+
+[ equal_range_words arr from to v comp;
+  #Ifdef SORTING_STATS;
+  comp=_sort_stat_wrap(comp);
+  #Endif;
+  sort_range_end=upper_bound_words(arr, from, to, v, comp);
+  return lower_bound_words(arr, from, sort_range_end-1, v, comp);
+];
+
+!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!
+! Sorted table routines.
+!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!
+
+[ sorted_insert tab max v comp   n p;
+  n=tab-->0;
+  if(n>=max)
+    return 0;
+  p=upper_bound_words(tab, 1, n, v, comp);
+  #Ifdef SORTING_STATS;
+  sort_stat_moves=sort_stat_moves+n-p+2;
+  #Endif;
+  _sort_copy(tab+p*WORDSIZE, tab+(p+1)*WORDSIZE, n-p+1);
+  tab-->p=v;
+  tab-->0=n+1;
+  return p;
+];
+
+[ sorted_find tab v comp   p;
+  p=equal_range_words(tab, 1, tab-->0, v, comp);
+  if(p==sort_range_end)
+    return 0;
+  return p;
+];
+
+[ sorted_remove_at tab p   n;
+  n=tab-->0;
+  if(p<1 || p>n)
+    rfalse;
+  #Ifdef SORTING_STATS;
+  sort_stat_moves=sort_stat_moves+n-p;
+  #Endif;
+  _sort_copy(tab+(p+1)*WORDSIZE, tab+p*WORDSIZE, n-p);
+  tab-->0=n-1;
+  rtrue;
+];
+
+[ sorted_remove tab v comp   p;
+  p=sorted_find(tab, v, comp);
+  if(p)
+    sorted_remove_at(tab, p);
+  return p;
+];
+
+[ sorted_range tab lo hi comp;
+  sort_range_end=upper_bound_words(tab, 1, tab-->0, hi, comp);
+  return lower_bound_words(tab, 1, sort_range_end-1, lo, comp);
+];
+
+! Merges from the end, so that each element is moved once, and the table
+! elements can be overwritten as soon as they have been moved.
+[ sorted_merge tab max arr from to comp   i j k u d a b;
+  #Ifdef SORTING_STATS;
+  comp=_sort_stat_wrap(comp);
+  #Ifnot;
+  if(comp>0 && comp<_SORT_MODES) {
+    u=(comp & SORT_UNSIGNED)*_SORT_HIGHBIT;
+    d=comp & SORT_DESCENDING;
+    comp=0;
+  }
+  #Endif;
+  i=tab-->0;
+  if(i+to-from+1>max)
+    rfalse;
+  k=i+to-from+1;
+  tab-->0=k;
+  #Ifdef SORTING_STATS;
+  sort_stat_moves=sort_stat_moves+k;
+  #Endif;
+  for(j=to: j>=from: k--) {
+    if(i>=1) {
+      if(comp) {
+        if(comp(tab-->i, arr-->j)) {
+          tab-->k=tab-->(i--);
+          continue;
+        }
+      } else {
+        a=tab-->i+u;
+        b=arr-->j+u;
+        if(d) {
+          a=~a;
+          b=~b;
+        }
+        if(a>b) {
+          tab-->k=tab-->(i--);
+          continue;
+        }
+      }
+    }
+    tab-->k=arr-->(j--);
+  }
+  rtrue;
+];
+
+#Endif; ! Not NOWORDSORT;
+#Endif; ! Not NODIRECTSORT;
+
+! The exact-match searches compare keys as unsigned words, which is what
+! the Glulx @binarysearch opcode does.
+
+#Ifdef TARGET_GLULX;
+
+[ bsearch_records arr stride key_offset from to v   start n res;
+  if(to<from)
+    return -1;
+  start=arr+from*stride;
+  n=to-from+1;
+  @binarysearch v WORDSIZE start stride n key_offset 4 res;
+  if(res==-1)
+    return -1;
+  return from+res;
+];
+
+#Ifnot; ! TARGET_GLULX
+
+[ bsearch_records arr stride key_offset from to v   m k;
+  arr=arr+key_offset;
+  while(from<=to) {
+    m=from+(to-from)/2;
+    k=(arr+m*stride)-->0;
+    #Ifdef SORTING_STATS;
+    sort_stat_compares++;
+    #Endif;
+    if(k==v)
+      return m;
+    if(k+$8000 < v+$8000)
+      from=m+1;
+    else
+      to=m-1;
+  }
+  return -1;
+];
+
+#Endif; ! TARGET_GLULX
+
+[ bsearch_words arr from to v;
+  return bsearch_records(arr, WORDSIZE, 0, from, to, v);
+];
+
+#Endif; ! Not NOSEARCH